@@ -14,17 +14,15 @@
 *   Tracks are stored in single WAV-RIFF file with (16) channels, 16-bit, (44100) samples per second, little-ended
 */
 
-//!@todo Feature: Soft start and stop to play / record, e.g. fade in / out
 //!@todo Feature: Show track length
-//!@todo Required: Rewrite header on save
 //!@todo Required: Remove unused header chuncks
 //!@todo Feature: Add / remove tracks / channels
 //!@todo Bug: Hangs when opening audio device if already in use, e.g. jackd is running
-//!@todo Feature: Show input (and output?) monitoring, particularly overload
 //!@todo Feature: Punch in/out points
 //!@todo Feature: Loop play / record
 //!@todo Bug: Head position shows beyond actual stop position, e.g. play to end of file - postion shows beyond end of file (a few ms) - see comment in Play() about using nBlock
 
+#define _FILE_OFFSET_BITS 64 //64-bit file offsets on 32-bit systems so that long sessions can exceed 2GB
 #include <string>
 #include <alsa/asoundlib.h>
 #include <ncurses.h> //provides user interface
@@ -36,6 +34,23 @@
 #include <termios.h> //provides control of terminal - set raw mode
 #include <sys/types.h> //provides lseek
 #include <unistd.h> //provides lseek
+#include <fcntl.h> //provides fallocate
+#include <atomic> //provides lock-free data shared between threads
+#include <thread> //provides audio and disk threads
+#include <sys/eventfd.h> //provides thread wake-up
+#include <poll.h> //provides wait for thread wake-up
+#include <getopt.h> //provides command line parsing
+#include <sys/timerfd.h> //provides user interface refresh timer
+#include <sys/resource.h> //provides benchmark CPU usage and real-time limits
+#include <sys/mman.h> //provides memory locking and memory-mapped replay
+#include <sched.h> //provides real-time scheduling
+#include <math.h> //provides float to integer rounding
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h> //provides SSE2 and AVX2 mix kernels
+#endif
+#ifdef __ARM_NEON
+#include <arm_neon.h> //provides NEON mix kernel
+#endif
 
 using namespace std;
 
@@ -43,15 +58,90 @@ using namespace std;
 static const int SAMPLERATE     = 44100; //Samples per second
 static const int SAMPLESIZE     = 2; //Quantity of bytes in each sample
 static const int PERIOD_SIZE    = 128; //Number of frames in each period (128 samples at 441000 takes approx 3ms)
-static const int MAX_TRACKS     = 16; //Quantity of mono tracks
+static const int MAX_TRACKS     = 16; //Quantity of mono tracks in new project and quantity of tracks shown at once
+static const int MAX_CHANNELS   = 64; //Maximum quantity of channels the mixer can mix
+static const float FLOAT_SCALE  = 32768.0f; //16-bit sample value of full scale (1.0) in float mix
+static const int FRAME_WIDTH[]  = {2, 4, 8, 12, 16, 24, 32, 64}; //Quantities of channels with kernels specialised at compile time
+static const int FRAME_WIDTHS   = sizeof(FRAME_WIDTH) / sizeof(int); //Quantity of specialised widths
 static const int RECORD_LATENCY = 3000; //microseconds of record latency
 static const int REPLAY_LATENCY = 30000; //microseconds of record latency
+static const int MONITOR_PERIODS = 2; //Periods queued for replay whilst monitoring input - input is heard this many periods after it is captured
+static const int UI_REFRESH     = 50; //milliseconds between user interface updates
+static const int METER_MS       = UI_REFRESH; //milliseconds between meter readings published to user interface
+static const int METER_DECIMATE = 8; //Meter every nth frame of each metered period
+static const int METER_INTERVAL = 8; //Meter every nth period - with METER_DECIMATE keeps metering within a few percent of mixing
+static const int METER_WIDTH    = 12; //Quantity of characters in each meter bar
+static const int METER_RANGE    = 60; //Range of each meter bar (dB below full scale)
+static const int16_t METER_CLIP = 32767; //Meter peak indicating clipping (largest 16-bit magnitude)
+static const int METER_HOLD_MS  = 2000; //milliseconds each input peak is held on its meter
+static const int METER_SHIFT    = 4; //Squares of metered samples are shifted right by this before summing in 32-bit
+static const int METER_BUS_FRAMES = 4; //Quantity of metered stereo output frames metered together as one frame of 2 x METER_BUS_FRAMES channels
+static const int METER_CHUNK    = 16; //Quantity of frames of shifted squares summed in 32-bit before adding to float readings (16 x 2^30 >> METER_SHIFT fits)
+static const int COMMAND_QUEUE_SIZE = 64; //Quantity of commands that may be queued to the audio thread
+static const int MAX_POLL_FDS   = 16; //Maximum quantity of file descriptors audio thread waits on
+static const int BENCH_IDLE_SECONDS = 2; //Duration of each idle benchmark
+static const int BENCH_STARTS   = 20; //Quantity of transport starts in each start latency benchmark
+static const int BENCH_ROLL     = 50; //Milliseconds to roll after each benchmark start
+static const int RT_PRIORITY    = 70; //Default SCHED_FIFO priority of audio thread in real-time mode
+static const int RT_STACK_PREFAULT = 256 * 1024; //Bytes of each thread's stack to prefault in real-time mode
+static const float PREFETCH_SECONDS = 4; //Default duration of audio to read ahead of play head
+static const int FADE_MS        = 20; //Default duration of monitor fade in / out when transport starts / stops (milliseconds)
+static const int FADE_UNITY     = 65536; //Transport fade level of full gain
+static const int RAMP_UNITY     = 128; //Gain ramp position at end of period - 32-bit mixes of MAX_CHANNELS full level tracks can be multiplied by this without overflow
+static const int PREFETCH_CHUNK = 1024 * 1024; //Minimum size of each disk read (bytes)
+static const int PREFETCH_TIMEOUT = 100; //Maximum milliseconds between disk thread checks
+static const off_t MAP_RESERVE  = 256 * 1024 * 1024; //Bytes mapped beyond end of file so that recording can extend file for a while before it is remapped
+static const int WRITE_SECONDS  = 4; //Duration of recorded audio that may be queued for writing to disk
+static const int WRITE_CHUNK    = 1024 * 1024; //Minimum size of each disk write (bytes) unless flushing
+static const off_t FILE_EXTENT  = 16 * 1024 * 1024; //Bytes allocated each time recording extends file
+static const int WAVE_HEADER_SIZE = 80; //Bytes before data in new WAVE file - RIFF, JUNK reserving space for RF64 ds64 chunk, fmt and data chunk headers
+static const int DS64_SIZE      = 28; //Size of ds64 chunk without table - RIFF, data and sample counts as 64-bit and table length
+static const size_t RELOCATE_CHUNK = 64 * 1024 * 1024; //Maximum bytes copied by each step of moving WAVE data (progress is shown between steps)
+static const int TAG_POS_BITS   = 48; //Low bits of each recorded block's tag hold its frame position, bits above hold armed tracks (track + 1, A-leg then B-leg)
+static const int64_t TAG_POS_MASK = ((int64_t)1 << TAG_POS_BITS) - 1; //Frame position bits of recorded block's tag
+static const int RECORD_HISTORY = SAMPLERATE; //Quantity of replayed frames retained to merge with recorded audio
+static const int GAIN_SHIFT     = 15; //Quantity of fractional bits in mixer gains (Q15)
+static const int16_t GAIN_UNITY = 32767; //Mixer gain of 0dB (largest Q15 value)
+static const int LEVEL_STEPS    = 192; //Quantity of 0.5dB monitor level steps - this step is -Inf
+static const int LEVEL_STEPS_6DB = 12; //Quantity of monitor level steps in 6dB
+static const int PAN_STEPS      = 16; //Quantity of pan steps either side of centre
+static const int MAX_MIX_THREADS = 8; //Maximum quantity of threads mixing each period (including audio thread)
+static const int MIX_GROUP_TRACKS = 16; //Minimum quantity of tracks mixed by each mix thread - fewer is not worth the hand-over
+static const int MIX_SPIN       = 20000; //Quantity of checks for next period a mix thread makes before sleeping
+static const int BENCH_MIX_TRACKS = 64; //Quantity of tracks in mixdown scaling benchmark
+static const int BENCH_MIX_RATE = 96000; //Sample rate of mixdown scaling benchmark
+static const int BENCH_MIX_PERIODS = 20000; //Quantity of periods mixed in each mixdown scaling benchmark
+static const int BENCH_COMPACT_TRACKS = 32; //Quantity of tracks in audible channel compaction benchmark
+static const int BENCH_KERNEL_TRACKS = 16; //Quantity of tracks in mix kernel benchmark
+static const int BENCH_KERNEL_PERIODS = 100000; //Quantity of periods mixed by each kernel in mix kernel benchmark
+static const int BENCH_METER_TRACKS[] = {16, 64}; //Quantities of tracks in metering benchmark
+static const int BENCH_METER_RUNS = 20; //Quantity of alternate runs with and without metering in metering benchmark - fastest of each is compared
+static const int TIMING_STEPS   = 8; //Quantity of timing histogram buckets in each doubling of duration
+static const int TIMING_BUCKETS = 256; //Quantity of timing histogram buckets (covers over 30 minutes in microseconds)
 
 //Transport control states
 static const int TC_STOP        = 0;
 static const int TC_PLAY        = 1;
 static const int TC_PAUSE       = 2;
 static const int TC_RECORD      = 4;
+//Audio thread commands
+static const int CMD_START      = 1; //Start transport
+static const int CMD_STOP       = 2; //Stop transport
+static const int CMD_LOCATE     = 3; //Move play head to lValue frames
+static const int CMD_RECORD_ENABLE = 4; //Enable (lValue = 1) or disable (lValue = 0) record mode
+static const int CMD_ARM_A      = 5; //Record A-leg to track lValue (-1 = none)
+static const int CMD_ARM_B      = 6; //Record B-leg to track lValue (-1 = none)
+//Planar storage tasks run whilst engine is stopped
+static const int STORAGE_IMPORT = 1; //Split interleaved WAVE file in to track files
+static const int STORAGE_EXPORT = 2; //Interleave track files in to interleaved WAVE file
+//Timed phases of each period
+static const int PHASE_READ     = 0; //Get period from read-ahead buffer
+static const int PHASE_MIX      = 1; //Mix period to stereo
+static const int PHASE_REPLAY   = 2; //Write period to replay device
+static const int PHASE_CAPTURE  = 3; //Read period from record device and merge with replayed frames
+static const int PHASE_DISK     = 4; //Write recorded audio to file (disk thread)
+static const int PHASE_CYCLE    = 5; //All audio thread work for one wake-up
+static const int PHASES         = 6;
 //Colours
 static const int WHITE_RED      = 1;
 static const int BLACK_GREEN    = 2;
@@ -59,40 +149,631 @@ static const int WHITE_BLUE     = 3;
 static const int RED_BLACK      = 4;
 static const int WHITE_MAGENTA  = 5;
 
-static string MIX_LEVEL[17] = {"  0dB", " -6dB", "-12dB", "-18dB", "-24dB", "-30dB", "-36dB", "-42dB", "-48dB", "-54dB", "-60dB", "-66dB", "-72dB", "-78dB", "-84dB", "-90dB", " -Inf"};
+static const char* PHASE_NAME[PHASES] = {"read", "mix", "replay", "capture", "disk", "cycle"};
+static const char* TIMING_HEADER = "Phase      p50    p99    max  miss blame"; //Heading of period timing table (microseconds)
+//Compile-time maths used to generate gain tables (C++11 constexpr functions must be a single return statement so series are recursive)
+static constexpr double PI = 3.14159265358979323846;
+
+/** Compile-time e^x for x >= 0 by Taylor series from term nTerm (value dTerm) */
+static constexpr double ConstExp(double x, int nTerm = 1, double dTerm = 1.0)
+{
+    return nTerm > 80 ? dTerm : dTerm + ConstExp(x, nTerm + 1, dTerm * x / nTerm);
+}
+
+/** Compile-time sine by Taylor series from term nTerm (value dTerm) - call with x² and x */
+static constexpr double ConstSinSeries(double x2, int nTerm, double dTerm)
+{
+    return nTerm > 20 ? dTerm : dTerm + ConstSinSeries(x2, nTerm + 1, -dTerm * x2 / ((2 * nTerm) * (2 * nTerm + 1)));
+}
+
+/** Compile-time sine for 0 <= x <= pi/2 */
+static constexpr double ConstSin(double x)
+{
+    return ConstSinSeries(x * x, 1, x);
+}
+
+/** Convert a gain from 0 to 1 to Q15 */
+static constexpr int16_t ToQ15(double dGain)
+{
+    return (int16_t)(dGain * GAIN_UNITY + 0.5);
+}
+
+/** Gain (0 to 1) of a monitor level step (0.5dB attenuation per step, LEVEL_STEPS = -Inf) */
+static constexpr double LevelRatio(int nStep)
+{
+    return nStep >= LEVEL_STEPS ? 0 : 1.0 / ConstExp(nStep * 0.5 / 20 * 2.30258509299404568402); //10^(-dB/20) = 1/e^(dB/20 x ln 10)
+}
+
+/** Gain (0 to 1) to A-leg (left) of a pan step (0 = fully left, 2 x PAN_STEPS = fully right) - constant power: A² + B² = 1 */
+static constexpr double PanRatioA(int nStep)
+{
+    return ConstSin((2 * PAN_STEPS - nStep) * PI / 4 / PAN_STEPS);
+}
+
+/** Gain (0 to 1) to B-leg (right) of a pan step (0 = fully left, 2 x PAN_STEPS = fully right) */
+static constexpr double PanRatioB(int nStep)
+{
+    return ConstSin(nStep * PI / 4 / PAN_STEPS);
+}
+
+/** Q15 gain of a monitor level step */
+static constexpr int16_t LevelGain(int nStep)
+{
+    return ToQ15(LevelRatio(nStep));
+}
+
+/** Q15 A-leg (left) gain of a pan step */
+static constexpr int16_t PanGainA(int nStep)
+{
+    return ToQ15(PanRatioA(nStep));
+}
+
+/** Q15 B-leg (right) gain of a pan step */
+static constexpr int16_t PanGainB(int nStep)
+{
+    return ToQ15(PanRatioB(nStep));
+}
+
+/** List of integers 0..COUNT-1 used to expand a table at compile time, e.g. MakeIndexList<4>::Type is IndexList<0, 1, 2, 3> */
+template <int... N> struct IndexList {};
+template <int COUNT, int... N> struct MakeIndexList : MakeIndexList<COUNT - 1, COUNT - 1, N...> {};
+template <int... N> struct MakeIndexList<0, N...> { typedef IndexList<N...> Type; };
+
+/** Gain tables generated by the compiler so that there is no start-up cost or floating point maths at run-time - Q15 for integer mix, float for float mix **/
+template <typename LIST> struct GainTables;
+template <int... N> struct GainTables<IndexList<N...>>
+{
+    static constexpr int16_t aLevel[sizeof...(N)] = {LevelGain(N)...}; //Gain of each monitor level step
+    static constexpr float afLevel[sizeof...(N)] = {(float)LevelRatio(N)...}; //Gain of each monitor level step
+};
+template <int... N> constexpr int16_t GainTables<IndexList<N...>>::aLevel[sizeof...(N)];
+template <int... N> constexpr float GainTables<IndexList<N...>>::afLevel[sizeof...(N)];
+template <typename LIST> struct PanTables;
+template <int... N> struct PanTables<IndexList<N...>>
+{
+    static constexpr int16_t aPanA[sizeof...(N)] = {PanGainA(N)...}; //A-leg gain of each pan step
+    static constexpr int16_t aPanB[sizeof...(N)] = {PanGainB(N)...}; //B-leg gain of each pan step
+    static constexpr float afPanA[sizeof...(N)] = {(float)PanRatioA(N)...}; //A-leg gain of each pan step
+    static constexpr float afPanB[sizeof...(N)] = {(float)PanRatioB(N)...}; //B-leg gain of each pan step
+};
+template <int... N> constexpr int16_t PanTables<IndexList<N...>>::aPanA[sizeof...(N)];
+template <int... N> constexpr int16_t PanTables<IndexList<N...>>::aPanB[sizeof...(N)];
+template <int... N> constexpr float PanTables<IndexList<N...>>::afPanA[sizeof...(N)];
+template <int... N> constexpr float PanTables<IndexList<N...>>::afPanB[sizeof...(N)];
+typedef GainTables<MakeIndexList<LEVEL_STEPS + 1>::Type> LevelTable;
+typedef PanTables<MakeIndexList<2 * PAN_STEPS + 1>::Type> PanTable;
+static_assert(LevelTable::aLevel[0] == GAIN_UNITY && LevelTable::aLevel[LEVEL_STEPS_6DB] == 16422 && LevelTable::aLevel[LEVEL_STEPS] == 0, "Level table not generated at compile time");
+static_assert(PanTable::aPanA[PAN_STEPS] == PanTable::aPanB[PAN_STEPS] && PanTable::aPanA[PAN_STEPS] == 23170, "Pan table not generated at compile time");
 
 /** Class representing single channel audio track **/
 class Track
 {
     public:
-        int nMonMixA; //A-leg monitor mix antenuation level (x 6Db) 0 - 16
-        int nMonMixB; //B-leg monitor mix antenuation level (x 6Db) 0 - 16
+        int nLevel; //Monitor mix attenuation (x 0.5dB) 0 - LEVEL_STEPS (LEVEL_STEPS = -Inf)
+        int nPan; //Monitor mix pan -PAN_STEPS (left) to PAN_STEPS (right)
         bool bMute; //True if track is muted
-        bool bRecording; //True if recording - mute output
 
-        /** Get the channel A mix down value of sample for this channel
-        *   @param  nValue Sample value
-        *   @return <i>int16_t</i> Antenuated value
+        /** Get the channel A mix down gain for this channel
+        *   @return <i>int16_t</i> Gain as fixed point with GAIN_SHIFT fractional bits
         */
-        int16_t MixA(int16_t nValue)
+        int16_t GetGainA()
         {
-            if(bMute || bRecording || 16 == nMonMixA)
+            if(bMute)
                 return 0;
-            else
-                return nValue >> nMonMixA;
+            return (LevelTable::aLevel[nLevel] * PanTable::aPanA[nPan + PAN_STEPS] + (1 << (GAIN_SHIFT - 1))) >> GAIN_SHIFT;
         }
 
-        /** Get the channel B mix down value of sample for this channel
-        *   @param  nValue Sample value
-        *   @return <i>int16_t</i> Antenuated adjusted value
+        /** Get the channel B mix down gain for this channel
+        *   @return <i>int16_t</i> Gain as fixed point with GAIN_SHIFT fractional bits
         */
-        int16_t MixB(int16_t nValue)
+        int16_t GetGainB()
         {
-            if(bMute || bRecording || 16 == nMonMixB)
+            if(bMute)
                 return 0;
-            else
-                return nValue >> nMonMixB;
+            return (LevelTable::aLevel[nLevel] * PanTable::aPanB[nPan + PAN_STEPS] + (1 << (GAIN_SHIFT - 1))) >> GAIN_SHIFT;
+        }
+
+        /** Get the channel A mix down gain for this channel for float mix
+        *   @return <i>float</i> Gain from 0 to 1
+        */
+        float GetFloatGainA()
+        {
+            if(bMute)
+                return 0;
+            return LevelTable::afLevel[nLevel] * PanTable::afPanA[nPan + PAN_STEPS];
+        }
+
+        /** Get the channel B mix down gain for this channel for float mix
+        *   @return <i>float</i> Gain from 0 to 1
+        */
+        float GetFloatGainB()
+        {
+            if(bMute)
+                return 0;
+            return LevelTable::afLevel[nLevel] * PanTable::afPanB[nPan + PAN_STEPS];
+        }
+};
+
+/** Structure representing a command sent from user interface to audio thread **/
+struct EngineCommand
+{
+    int nCommand; //Command (CMD_xxx)
+    int64_t lValue; //Command parameter
+    int64_t nQueued; //Time command was queued (microseconds)
+};
+
+/** Lock-free single producer, single consumer queue
+*   One thread may push whilst another thread pops without either blocking
+*/
+template <typename T, unsigned int SIZE> class SpscQueue
+{
+    public:
+        SpscQueue() : m_nRead(0), m_nWrite(0) {}
+
+        /** Add an item to the queue (producer thread only)
+        *   @param  item Item to add
+        *   @return <i>bool</i> True on success, false if queue is full
+        */
+        bool Push(const T& item)
+        {
+            unsigned int nWrite = m_nWrite.load(memory_order_relaxed);
+            unsigned int nNext = (nWrite + 1) % SIZE;
+            if(nNext == m_nRead.load(memory_order_acquire))
+                return false;
+            m_aItems[nWrite] = item;
+            m_nWrite.store(nNext, memory_order_release);
+            return true;
+        }
+
+        /** Remove an item from the queue (consumer thread only)
+        *   @param  item Reference to item to populate
+        *   @return <i>bool</i> True on success, false if queue is empty
+        */
+        bool Pop(T& item)
+        {
+            unsigned int nRead = m_nRead.load(memory_order_relaxed);
+            if(nRead == m_nWrite.load(memory_order_acquire))
+                return false;
+            item = m_aItems[nRead];
+            m_nRead.store((nRead + 1) % SIZE, memory_order_release);
+            return true;
+        }
+
+    private:
+        T m_aItems[SIZE]; //Queued items
+        atomic<unsigned int> m_nRead; //Index of next item to pop
+        atomic<unsigned int> m_nWrite; //Index of next item to push
+};
+
+/** Lock-free triple buffer passing latest state from one thread to another
+*   Writer fills a private buffer then swaps it with the shared buffer. Reader swaps the shared buffer with its private buffer when a new one is published.
+*   Neither thread blocks or allocates and the reader always sees a complete, consistent state.
+*/
+template <typename T> class TripleBuffer
+{
+    public:
+        TripleBuffer() : m_nWrite(0), m_nShared(1), m_nRead(2) {}
+
+        /** Get buffer to populate before publishing (writer thread only) - content is stale so must be fully populated */
+        T& GetWriteBuffer()
+        {
+            return m_aBuffers[m_nWrite];
+        }
+
+        /** Publish the write buffer (writer thread only) */
+        void Publish()
+        {
+            m_nWrite = m_nShared.exchange(m_nWrite | NEW, memory_order_acq_rel) & INDEX;
+        }
+
+        /** Take the latest published buffer if there is one (reader thread only)
+        *   @return <i>bool</i> True if a new buffer was published since last update
+        */
+        bool Update()
+        {
+            if(!(m_nShared.load(memory_order_relaxed) & NEW))
+                return false;
+            m_nRead = m_nShared.exchange(m_nRead, memory_order_acq_rel) & INDEX;
+            return true;
+        }
+
+        /** Get the buffer taken by last update (reader thread only) */
+        const T& GetReadBuffer() const
+        {
+            return m_aBuffers[m_nRead];
+        }
+
+    private:
+        static const int INDEX = 3; //Mask of buffer index in m_nShared
+        static const int NEW = 4; //Flag in m_nShared indicating buffer published since reader last updated
+        T m_aBuffers[3];
+        int m_nWrite; //Index of writer's buffer
+        atomic<int> m_nShared; //Index of shared buffer and NEW flag
+        int m_nRead; //Index of reader's buffer
+};
+
+/** Structure representing mixer state published by user interface to audio thread **/
+struct MixerSnapshot
+{
+    alignas(16) int16_t pGainA[MAX_CHANNELS]; //Gain of each track to A-leg (left) output
+    alignas(16) int16_t pGainB[MAX_CHANNELS]; //Gain of each track to B-leg (right) output
+    alignas(32) float pFloatGainA[MAX_CHANNELS]; //Gain of each track to A-leg output for float mix
+    alignas(32) float pFloatGainB[MAX_CHANNELS]; //Gain of each track to B-leg output for float mix
+    int16_t pMonitorGainA[2]; //Gain of A-leg and B-leg input to A-leg output whilst monitoring input
+    int16_t pMonitorGainB[2]; //Gain of A-leg and B-leg input to B-leg output whilst monitoring input
+};
+
+/** Structure representing meter readings published by audio thread to user interface **/
+struct MeterSnapshot
+{
+    int16_t pPeak[MAX_CHANNELS]; //Largest magnitude of each track's samples since last snapshot (before level and pan, 0 if muted)
+    float pPower[MAX_CHANNELS]; //Mean square of each track's samples since last snapshot (full scale = 1.0)
+    int16_t pBusPeak[2]; //Largest magnitude of A-leg and B-leg output since last snapshot
+    float pBusPower[2]; //Mean square of A-leg and B-leg output since last snapshot
+    int16_t pInputPeak[2]; //Largest magnitude of A-leg and B-leg capture since last snapshot
+};
+
+/** Pointer to a function mixing a range of channels of interleaved 16-bit frames to an interleaved stereo bus
+*   Products of each pair of adjacent channels (starting at nFirst) are summed then shifted by GAIN_SHIFT so that every kernel gives identical results
+*   @param  pFrames Little-endian frames to mix
+*   @param  nFrames Quantity of frames
+*   @param  nFrameSize Size of each frame in bytes
+*   @param  nFirst Index of first channel to mix
+*   @param  nLast Index after last channel to mix
+*   @param  pGainA Gain of each channel to A-leg
+*   @param  pGainB Gain of each channel to B-leg
+*   @param  pBus Buffer to populate with A-leg and B-leg of each frame
+*/
+typedef void (*MixKernel)(const unsigned char* pFrames, int nFrames, int nFrameSize, int nFirst, int nLast, const int16_t* pGainA, const int16_t* pGainB, int32_t* pBus);
+
+/** Pointer to a function summing 32-bit stereo buses and saturating the result to 16-bit output
+*   Mix buses have headroom for any quantity of full level tracks so output clips rather than wraps around
+*   @param  ppBuses Interleaved stereo buses to sum
+*   @param  nBuses Quantity of buses
+*   @param  nSamples Quantity of samples (2 x frames) in each bus
+*   @param  pOutput Buffer to populate with interleaved stereo output
+*/
+typedef void (*PackKernel)(const int32_t* const* ppBuses, int nBuses, int nSamples, int16_t* pOutput);
+
+/** Pointer to a function converting a range of channels of interleaved 16-bit frames to float frames (-1.0 to +1.0) at the file boundary of the float mix
+*   @param  pFrames Little-endian frames to convert
+*   @param  nFrames Quantity of frames
+*   @param  nChannels Quantity of channels in each frame
+*   @param  nFirst Index of first channel to convert
+*   @param  nLast Index after last channel to convert
+*   @param  pOutput Buffer to populate with float frames, same layout as pFrames
+*/
+typedef void (*ConvertKernel)(const unsigned char* pFrames, int nFrames, int nChannels, int nFirst, int nLast, float* pOutput);
+
+/** Pointer to a function mixing a range of channels of interleaved float frames to an interleaved stereo float bus
+*   @param  pFrames Float frames to mix
+*   @param  nFrames Quantity of frames
+*   @param  nChannels Quantity of channels in each frame
+*   @param  nFirst Index of first channel to mix
+*   @param  nLast Index after last channel to mix
+*   @param  pGainA Gain of each channel to A-leg
+*   @param  pGainB Gain of each channel to B-leg
+*   @param  pBus Buffer to populate with A-leg and B-leg of each frame
+*/
+typedef void (*FloatMixKernel)(const float* pFrames, int nFrames, int nChannels, int nFirst, int nLast, const float* pGainA, const float* pGainB, float* pBus);
+
+/** Pointer to a function summing float stereo buses and converting the result to saturated 16-bit output at the device boundary of the float mix
+*   @param  ppBuses Interleaved stereo buses to sum
+*   @param  nBuses Quantity of buses
+*   @param  nSamples Quantity of samples (2 x frames) in each bus
+*   @param  pOutput Buffer to populate with interleaved stereo output
+*/
+typedef void (*FloatPackKernel)(const float* const* ppBuses, int nBuses, int nSamples, int16_t* pOutput);
+
+/** Pointer to a function merging captured samples with replayed frames to be written to disk
+*   @param  pFrames Buffer to populate with frames
+*   @param  pRecBuffer Interleaved stereo captured samples
+*   @param  lFrame Position of first frame in file
+*   @param  nFrames Quantity of frames
+*/
+typedef void (*MergeKernel)(unsigned char* pFrames, const unsigned char* pRecBuffer, int64_t lFrame, int nFrames);
+
+/** Pointer to a function metering a range of channels of interleaved 16-bit frames
+*   Accumulates rather than replaces so that readings can span several periods and threads can meter their own channels
+*   @param  pFrames Little-endian frames to meter
+*   @param  nFrames Quantity of frames
+*   @param  nFrameSize Distance between frames in bytes (a multiple of frame size to meter every nth frame)
+*   @param  nFirst Index of first channel to meter
+*   @param  nLast Index after last channel to meter
+*   @param  pPeak Largest magnitude of each channel, raised by any larger sample
+*   @param  pSquares Sum of squares of each channel's samples, added to
+*/
+typedef void (*MeterKernel)(const unsigned char* pFrames, int nFrames, int nFrameSize, int nFirst, int nLast, int16_t* pPeak, float* pSquares);
+
+/** Populate a kernel table entry with a kernel template instantiated for each width in FRAME_WIDTH */
+#define FRAME_WIDTH_KERNELS(KERNEL) {KERNEL<2>, KERNEL<4>, KERNEL<8>, KERNEL<12>, KERNEL<16>, KERNEL<24>, KERNEL<32>, KERNEL<64>}
+static_assert(FRAME_WIDTHS == 8, "FRAME_WIDTH_KERNELS must list each width in FRAME_WIDTH");
+
+/** Structure describing a mix kernel **/
+struct MixKernelInfo
+{
+    const char* sName; //Name of instruction set
+    MixKernel pKernel; //Kernel function for any quantity of channels
+    MixKernel apWidth[FRAME_WIDTHS]; //Kernel functions specialised for each width in FRAME_WIDTH
+    PackKernel pPack; //Bus sum and saturate function
+    ConvertKernel pConvert; //16-bit to float conversion function
+    FloatMixKernel pFloatMix; //Float kernel function
+    FloatPackKernel pFloatPack; //Float bus sum and conversion function
+    MeterKernel pMeter; //Peak and power metering function
+    int nCompactRatio; //Only mix audible channels alone when at most 1 / nCompactRatio of channels are audible - else kernel mixing all is quicker
+    bool bSupported; //True if CPU supports kernel's instruction set
+};
+
+/** Structure representing a group of tracks mixed by one mix thread to partial stereo buses **/
+struct MixGroup
+{
+    alignas(64) int32_t pBus[PERIOD_SIZE * 2]; //Partial stereo mix of the group's tracks (interleaved A-leg, B-leg)
+    alignas(64) float pFloatBus[PERIOD_SIZE * 2]; //Partial stereo float mix of the group's tracks
+    alignas(64) int32_t pRampBus[PERIOD_SIZE * 2]; //Partial stereo mix with gains at start of period whilst gains ramp
+    alignas(64) float pFloatRampBus[PERIOD_SIZE * 2]; //Partial stereo float mix with gains at start of period whilst gains ramp
+    int nFirst; //Index in g_pActive of first track in group
+    int nLast; //Index in g_pActive after last track in group
+    MixKernel pKernel; //Mix kernel for the group's quantity of tracks
+    int fdWake; //Event used to wake mix thread
+    unsigned int nPeriod; //Value of g_nMixPeriod for last period seen by mix thread
+    atomic<bool> bSleeping; //True whilst mix thread is waiting for its event
+};
+
+/** Touch each page of a buffer so that it is resident (must not be in use by another thread) */
+void Prefault(const void* pBuffer, size_t nSize)
+{
+    volatile unsigned char* pByte = (volatile unsigned char*)pBuffer;
+    long lPage = sysconf(_SC_PAGESIZE);
+    for(size_t nOffset = 0; nOffset < nSize; nOffset += lPage)
+        pByte[nOffset] = pByte[nOffset];
+}
+
+/** Lock-free single producer, single consumer ring of fixed size blocks
+*   Producer fills contiguous blocks in place then commits them. Consumer reads blocks in place then releases them.
+*   Each block has a size (bytes of valid data) which may be less than block size, e.g. at end of file.
+*/
+class BlockRing
+{
+    public:
+        BlockRing() : m_pBuffer(NULL), m_pSize(NULL), m_pTag(NULL), m_nBlockSize(0), m_nBlocks(0), m_nRead(0), m_nWrite(0) {}
+        ~BlockRing()
+        {
+            delete[] m_pBuffer;
+            delete[] m_pSize;
+            delete[] m_pTag;
+        }
+
+        /** Allocate ring - must not be called whilst any thread is using the ring
+        *   @param  nBlockSize Size of each block in bytes
+        *   @param  nBlocks Quantity of blocks (one block is always kept empty)
+        */
+        void Init(int nBlockSize, int nBlocks)
+        {
+            delete[] m_pBuffer;
+            delete[] m_pSize;
+            delete[] m_pTag;
+            m_nBlockSize = nBlockSize;
+            m_nBlocks = nBlocks;
+            m_pBuffer = new unsigned char[nBlockSize * nBlocks];
+            m_pSize = new int[nBlocks];
+            m_pTag = new int64_t[nBlocks];
+            memset(m_pBuffer, 0, nBlockSize * nBlocks);
+            memset(m_pSize, 0, nBlocks * sizeof(int));
+            memset(m_pTag, 0, nBlocks * sizeof(int64_t));
+            m_nRead = 0;
+            m_nWrite = 0;
+        }
+
+        /** Touch each page of ring so that it is resident - must not be called whilst any thread is using the ring */
+        void Prefault()
+        {
+            ::Prefault(m_pBuffer, m_nBlockSize * m_nBlocks);
+            ::Prefault(m_pSize, m_nBlocks * sizeof(int));
+            ::Prefault(m_pTag, m_nBlocks * sizeof(int64_t));
         }
+
+        /** Get quantity of blocks that may be written (producer)
+        *   @param  bContiguous True to limit to blocks before end of buffer
+        *   @return <i>int</i> Quantity of free blocks
+        */
+        int GetWriteSpace(bool bContiguous = false)
+        {
+            int nRead = m_nRead.load(memory_order_acquire);
+            int nWrite = m_nWrite.load(memory_order_relaxed);
+            if(nWrite < nRead)
+                return nRead - nWrite - 1;
+            if(bContiguous)
+                return m_nBlocks - nWrite - (0 == nRead ? 1 : 0);
+            return m_nBlocks - nWrite + nRead - 1;
+        }
+
+        /** Get pointer to next block to write (producer) */
+        unsigned char* GetWritePointer() { return m_pBuffer + m_nWrite.load(memory_order_relaxed) * m_nBlockSize; }
+
+        /** Set the quantity of valid bytes in a block before it is committed (producer)
+        *   @param  nBlock Index of block relative to next block to write
+        *   @param  nSize Quantity of valid bytes
+        */
+        void SetSize(int nBlock, int nSize) { m_pSize[(m_nWrite.load(memory_order_relaxed) + nBlock) % m_nBlocks] = nSize; }
+
+        /** Set a user value associated with a block before it is committed (producer), e.g. position in file
+        *   @param  nBlock Index of block relative to next block to write
+        *   @param  nTag User value
+        */
+        void SetTag(int nBlock, int64_t nTag) { m_pTag[(m_nWrite.load(memory_order_relaxed) + nBlock) % m_nBlocks] = nTag; }
+
+        /** Make written blocks available to consumer (producer)
+        *   @param  nBlocks Quantity of blocks to commit
+        */
+        void CommitWrite(int nBlocks) { m_nWrite.store((m_nWrite.load(memory_order_relaxed) + nBlocks) % m_nBlocks, memory_order_release); }
+
+        /** Get index of next block to write (producer) */
+        int GetWriteIndex() { return m_nWrite.load(memory_order_relaxed); }
+
+        /** Get quantity of blocks that may be read (consumer)
+        *   @param  bContiguous True to limit to blocks before end of buffer
+        *   @return <i>int</i> Quantity of committed blocks
+        */
+        int GetReadSpace(bool bContiguous = false)
+        {
+            int nRead = m_nRead.load(memory_order_relaxed);
+            int nWrite = m_nWrite.load(memory_order_acquire);
+            if(nWrite >= nRead)
+                return nWrite - nRead;
+            if(bContiguous)
+                return m_nBlocks - nRead;
+            return m_nBlocks - nRead + nWrite;
+        }
+
+        /** Get pointer to a block to read (consumer)
+        *   @param  pSize Pointer to populate with quantity of valid bytes in block
+        *   @param  pTag Pointer to populate with block's user value (NULL to ignore)
+        *   @param  nBlock Index of block relative to next block to read
+        *   @return <i>unsigned char*</i> Pointer to block or NULL if block not committed
+        */
+        const unsigned char* GetReadPointer(int* pSize, int64_t* pTag = NULL, int nBlock = 0)
+        {
+            if(nBlock >= GetReadSpace())
+                return NULL;
+            int nRead = (m_nRead.load(memory_order_relaxed) + nBlock) % m_nBlocks;
+            *pSize = m_pSize[nRead];
+            if(pTag)
+                *pTag = m_pTag[nRead];
+            return m_pBuffer + nRead * m_nBlockSize;
+        }
+
+        /** Release blocks obtained with GetReadPointer (consumer)
+        *   @param  nBlocks Quantity of blocks to release
+        *   @return <i>int</i> Quantity of free blocks after release
+        */
+        int Release(int nBlocks = 1)
+        {
+            int nRead = (m_nRead.load(memory_order_relaxed) + nBlocks) % m_nBlocks;
+            m_nRead.store(nRead, memory_order_release);
+            return (nRead - m_nWrite.load(memory_order_acquire) + m_nBlocks - 1) % m_nBlocks;
+        }
+
+        /** Discard blocks up to (not including) a block index (consumer)
+        *   @param  nIndex Index of next block to read, as returned by GetWriteIndex
+        */
+        void Flush(int nIndex) { m_nRead.store(nIndex, memory_order_release); }
+
+        /** Discard all committed blocks (consumer) */
+        void Flush() { Flush(m_nWrite.load(memory_order_acquire)); }
+
+    private:
+        unsigned char* m_pBuffer; //Block data
+        int* m_pSize; //Quantity of valid bytes in each block
+        int64_t* m_pTag; //User value of each block
+        int m_nBlockSize; //Size of each block in bytes
+        int m_nBlocks; //Quantity of blocks
+        atomic<int> m_nRead; //Index of next block to read
+        atomic<int> m_nWrite; //Index of next block to write
+};
+
+/** Lock-free histogram of durations
+*   One thread adds durations whilst other threads read percentiles. Buckets are logarithmic with TIMING_STEPS per doubling so percentiles are within 13%.
+*   Also counts durations that missed their deadline and times the owner blamed a missed deadline on this histogram's phase.
+*/
+class TimingHistogram
+{
+    public:
+        TimingHistogram() : m_nCount(0), m_nMax(0), m_nMisses(0), m_nBlamed(0), m_bReset(false)
+        {
+            for(int i = 0; i < TIMING_BUCKETS; ++i)
+                m_aBuckets[i] = 0;
+        }
+
+        /** Add a duration (writer thread only)
+        *   @param  nDuration Duration in microseconds
+        *   @param  nDeadline Longest duration that meets deadline in microseconds
+        */
+        void Add(int64_t nDuration, int64_t nDeadline)
+        {
+            if(m_bReset.exchange(false, memory_order_acquire))
+                Clear();
+            int nBucket = GetBucket(nDuration);
+            m_aBuckets[nBucket].store(m_aBuckets[nBucket].load(memory_order_relaxed) + 1, memory_order_relaxed);
+            m_nCount.store(m_nCount.load(memory_order_relaxed) + 1, memory_order_release);
+            if(nDuration > m_nMax.load(memory_order_relaxed))
+                m_nMax.store(nDuration, memory_order_relaxed);
+            if(nDuration > nDeadline)
+                m_nMisses.store(m_nMisses.load(memory_order_relaxed) + 1, memory_order_relaxed);
+        }
+
+        /** Count a missed deadline caused mostly by this phase (writer thread only) */
+        void Blame() { m_nBlamed.store(m_nBlamed.load(memory_order_relaxed) + 1, memory_order_relaxed); }
+
+        /** Request all counts are cleared by writer thread before it next adds a duration (any thread) */
+        void Reset() { m_bReset.store(true, memory_order_release); }
+
+        /** Get a percentile of durations (any thread)
+        *   @param  nPercent Percentage of durations at or below result
+        *   @return <i>int64_t</i> Upper bound of bucket holding percentile in microseconds or 0 if no durations added
+        */
+        int64_t GetPercentile(int nPercent) const
+        {
+            unsigned int nCount = m_nCount.load(memory_order_acquire);
+            unsigned int nTarget = ((uint64_t)nCount * nPercent + 99) / 100;
+            unsigned int nTotal = 0;
+            for(int nBucket = 0; nBucket < TIMING_BUCKETS && nCount; ++nBucket)
+            {
+                nTotal += m_aBuckets[nBucket].load(memory_order_relaxed);
+                if(nTotal >= nTarget)
+                    return min(GetBucketLimit(nBucket), GetMax());
+            }
+            return GetMax();
+        }
+
+        /** Get quantity of durations added (any thread) */
+        unsigned int GetCount() const { return m_nCount.load(memory_order_relaxed); }
+
+        /** Get longest duration in microseconds (any thread) */
+        int64_t GetMax() const { return m_nMax.load(memory_order_relaxed); }
+
+        /** Get quantity of durations that missed their deadline (any thread) */
+        unsigned int GetMisses() const { return m_nMisses.load(memory_order_relaxed); }
+
+        /** Get quantity of missed deadlines blamed on this phase (any thread) */
+        unsigned int GetBlamed() const { return m_nBlamed.load(memory_order_relaxed); }
+
+    private:
+        /** Clear all counts (writer thread only) */
+        void Clear()
+        {
+            for(int i = 0; i < TIMING_BUCKETS; ++i)
+                m_aBuckets[i].store(0, memory_order_relaxed);
+            m_nCount.store(0, memory_order_relaxed);
+            m_nMax.store(0, memory_order_relaxed);
+            m_nMisses.store(0, memory_order_relaxed);
+            m_nBlamed.store(0, memory_order_relaxed);
+        }
+
+        /** Get index of bucket holding a duration */
+        static int GetBucket(int64_t nDuration)
+        {
+            if(nDuration < TIMING_STEPS)
+                return nDuration < 0 ? 0 : (int)nDuration;
+            int nOctave = 63 - __builtin_clzll(nDuration); //TIMING_STEPS is 2^3 so first octave with more than one value per bucket is 3
+            int nBucket = (nOctave - 2) * TIMING_STEPS + (int)((nDuration >> (nOctave - 3)) & (TIMING_STEPS - 1));
+            return min(nBucket, TIMING_BUCKETS - 1);
+        }
+
+        /** Get longest duration held by a bucket */
+        static int64_t GetBucketLimit(int nBucket)
+        {
+            if(nBucket < TIMING_STEPS)
+                return nBucket;
+            int nOctave = nBucket / TIMING_STEPS + 2;
+            return ((int64_t)(TIMING_STEPS + nBucket % TIMING_STEPS + 1) << (nOctave - 3)) - 1;
+        }
+
+        atomic<unsigned int> m_aBuckets[TIMING_BUCKETS]; //Quantity of durations in each bucket
+        atomic<unsigned int> m_nCount; //Quantity of durations added
+        atomic<int64_t> m_nMax; //Longest duration
+        atomic<unsigned int> m_nMisses; //Quantity of durations longer than deadline
+        atomic<unsigned int> m_nBlamed; //Quantity of missed deadlines blamed on this phase
+        atomic<bool> m_bReset; //True to request writer clears counts
 };
 
 /** Write a 16-bit, little-endian word to a char buffer */
@@ -111,42 +792,298 @@ void SetLE32(char* pBuffer, uint32_t nWord)
     *(pBuffer + 3) = char((nWord >> 24) & 0xFF);
 }
 
+/** Write a 64-bit, little-endian word to a char buffer */
+void SetLE64(char* pBuffer, uint64_t nWord)
+{
+    SetLE32(pBuffer, nWord & 0xFFFFFFFF);
+    SetLE32(pBuffer + 4, nWord >> 32);
+}
+
+/** Read a 16-bit, little-endian word from a char buffer */
+uint16_t GetLE16(const char* pBuffer)
+{
+    const unsigned char* pBytes = (const unsigned char*)pBuffer;
+    return pBytes[0] | (pBytes[1] << 8);
+}
+
+/** Read a 32-bit, little-endian word from a char buffer */
+uint32_t GetLE32(const char* pBuffer)
+{
+    const unsigned char* pBytes = (const unsigned char*)pBuffer;
+    return pBytes[0] | (pBytes[1] << 8) | (pBytes[2] << 16) | ((uint32_t)pBytes[3] << 24);
+}
+
+/** Read a 64-bit, little-endian word from a char buffer */
+uint64_t GetLE64(const char* pBuffer)
+{
+    return GetLE32(pBuffer) | ((uint64_t)GetLE32(pBuffer + 4) << 32);
+}
+
 //Functions
 static bool OpenFile(); //Opens WAVE file
+static bool RelocateData(off_t offData, off_t nSize, off_t offEnd); //Move WAVE data chunk to end of file, after chunks that follow it
+static void ShowProgress(const char* sTask, int nPercent); //Show progress of a long file operation (nPercent < 0 to clear)
 static void CloseFile(); //Closes WAVE file
+static bool IsProjectOpen(); //True if project's WAVE file or track files are open
+static string GetTrackFilename(const string& sProject, int nTrack); //Get path of a track's WAVE file in planar project
+static bool OpenTracks(); //Opens each track's mono WAVE file of planar project, splitting interleaved WAVE file if there are none
+static void CloseTracks(); //Closes each track's WAVE file
+static void UpdateTrackHeader(int fd, off_t offEnd); //Write RIFF and data sizes of a track's WAVE file
+static bool ImportTracks(); //Split interleaved WAVE file in to a mono WAVE file for each track (engine stopped)
+static bool ExportTracks(); //Interleave each track's WAVE file in to interleaved WAVE file (engine stopped)
+static void GatherTrack(unsigned char* pSamples, const unsigned char* pFrames, int nTrack, int nFrames); //Copy a track's samples from interleaved frames
+static void SpreadTrack(unsigned char* pFrames, const unsigned char* pSamples, int nTrack, int nFrames); //Copy a track's samples in to interleaved frames
+static ssize_t ReadTracks(unsigned char* pFrames, int nFrames, int64_t lFrom); //Read frames from files of tracks being read ahead, others silent (disk read-ahead thread)
+static bool WriteTracks(const unsigned char* pFrames, size_t nBytes, int64_t nTag); //Write armed tracks' samples from recorded frames to their files (disk write-behind thread)
+static void RunStorageTask(); //Stop engine, import or export interleaved WAVE file and reload project (user interface thread)
 static bool OpenReplay(); //Opens audio replay (output) device
 static void CloseReplay(); //Closes audio replay device
 static bool OpenRecord(); //Opens audio record (input) device
 static void CloseRecord(); //Closes audio record device
-static void SetPlayHead(int nPosition); //Positions the playhead at the specified number of frames from the start
+static void SetPlayHead(int64_t nPosition); //Positions the playhead at the specified number of frames from the start
 static void ShowHeadPosition(); //Update the head position indication
 static void ShowMenu(); //Update display
-static void HandleControl(); //Handle user input
+static void ShowStatus(); //Update error indication
+static void ShowTiming(); //Update period timing table
+static void FormatTiming(int nPhase, char* pBuffer, size_t nSize); //Format a row of period timing table
+static int64_t AddTiming(int nPhase, int64_t nStart); //Record duration of a phase of current period (audio thread)
+static void CheckDeadline(int64_t nWake); //Record audio thread cycle duration and blame any missed deadline on its slowest phase (audio thread)
+static bool HandleControl(); //Handle user input
+static int GetMixPad(); //Get attenuation (x 6dB) that allows all tracks to play at full level without clipping
+static void AdjustLevel(int nSteps); //Attenuate selected track by nSteps x 0.5dB or unmute it
+static void AdjustPan(int nSteps); //Pan selected track nSteps to the right or unmute it
+static void SetPan(int nPan, int nLevel); //Unmute selected track and set its pan and level
+static int64_t GetMicroseconds(); //Get monotonic time in microseconds
+static void SendCommand(int nCommand, int64_t lValue = 0); //Queue a command to the audio thread
+static void HandleCommands(); //Process queued commands within audio thread
+static void StopTransport(); //Stop playing and recording (audio thread)
+static void Engine(); //Audio thread main loop
+static void StartEngine(); //Start mix, disk and audio threads
+static void StopEngine(); //Stop audio, mix and disk threads, writing all queued recorded audio
+static void Benchmark(); //Run performance benchmarks
+static void StartRealtime(bool bAudio); //Configure calling thread for real-time mode
+static void SetFlushToZero(bool bEnable); //Enable or disable flushing denormal floats to zero in calling thread
+static void Prefetch(); //Disk read-ahead thread main loop
+static void PrefetchSeek(int64_t lFrame); //Request read-ahead from new position (audio thread)
+static int PrefetchRead(const unsigned char** ppData); //Get next period of read-ahead data (audio thread)
+static void PrefetchWake(); //Wake disk read-ahead thread
+static void PrefetchRelease(int nFrames); //Finish with period of read-ahead data after replaying nFrames (audio thread)
+static void PrefetchReread(); //Read ahead again if tracks that were not read have become audible (audio thread whilst not holding read-ahead data)
+static bool PrefetchMap(unsigned int nRequest, int64_t& lReady, int64_t& lDropped, bool& bEnd); //Make mapped data ahead of play head resident and release data behind it (disk thread)
+static bool MapFile(); //Map WAVE data for replay without copying
+static bool RemapFile(off_t offNeeded); //Map WAVE data up to at least offNeeded whilst audio thread may still read previous mapping (disk thread)
+static void UnmapFile(); //Unmap WAVE data
+static void Writer(); //Disk write-behind thread main loop
+static void WriterFlush(); //Request all queued recorded audio is written to disk
+static void WriterWait(); //Wait for all queued recorded audio to be written to disk (not audio thread)
+static void ExtendFile(int fd, off_t offEnd, off_t offNeeded, off_t& offAllocated); //Allocate file space in large extents beyond offEnd up to at least offNeeded (disk write-behind thread)
+static void TrimFile(); //Release file space allocated beyond end of data of WAVE file or track files (disk write-behind thread or whilst it is idle)
+static void TrimFile(int fd, off_t offEnd, off_t& offAllocated); //Release a file's space allocated beyond offEnd
+static void ResetRecordPosition(); //Align recorded audio with play head (audio thread)
+static void DeferStart(snd_pcm_t* pPcm); //Stop audio device starting automatically when data is written or read
+static void StartDuplex(); //Prime replay then start replay and record together and measure record offset (audio thread)
+static void StopDuplex(); //Stop replay and record, leaving them prepared for next start (audio thread)
+static void RestartDuplex(); //Restart replay and record after an xrun (audio thread)
+static void PublishMixer(); //Publish track gains to audio thread
+static void UpdateMixer(); //Calculate audio thread mixer gains from latest published gains and record state (audio thread)
+static void RampMixer(); //Advance transport fade and calculate gains at start and end of next period (audio thread)
+static void StartFade(int nDir); //Start fading monitor output in (nDir = 1) or out (nDir = -1) (audio thread)
+static void CompactMixer(bool bCompact = true); //List audible channels and divide them between mix threads (audio thread whilst not mixing)
+static void SetMixGroups(); //Divide audible tracks between mix threads (whilst not mixing)
+static void StartMixers(); //Start mix threads
+static void StopMixers(); //Stop mix threads
+static void MixWorker(int nGroup); //Mix thread main loop
+static void MixGroupTracks(MixGroup& group, const unsigned char* pFrames, int nFrames); //Mix a group's tracks to its partial buses
+static void MixGroupFloat(MixGroup& group, const unsigned char* pFrames, int nFrames); //Mix a group's tracks to its partial float buses
+static void MeterGroupTracks(const MixGroup& group, const unsigned char* pFrames, int nFrames); //Add a period of a group's tracks to their meter readings
+static void MeterOutput(const int16_t* pOutput, int nFrames); //Add a period of output to its meter readings (audio thread)
+static void PublishMeters(); //Publish meter readings to user interface and start new readings (audio thread)
+static void MeterInput(const unsigned char* pRecBuffer, int nFrames); //Add captured frames that are not merged to input meter readings (audio thread)
+static void ResetMeters(); //Discard meter readings (audio thread or whilst not rolling)
+static void ShowMeter(WINDOW* pWindow, int nPeak, float fPower, bool bClip); //Draw a meter bar at cursor
+static void ShowLevel(WINDOW* pWindow, const Track& track); //Draw a track's level and pan (or mute) at cursor
+static Track& GetSelectedTrack(); //Get selected track or monitored input
+static void MonitorInput(int16_t* pOutput); //Mix captured period to output buffer at monitor gains (audio thread)
+static void SelectMixKernel(); //Detect CPU features and select fastest mix kernel
+static MixKernel GetMixKernel(int nKernel, int nChannels); //Get mix kernel specialised for a quantity of channels
+static void SelectFrameKernels(); //Select kernels specialised for project's quantity of channels
+static void Mixdown(const unsigned char* pFrames, int nFrames); //Mix a period of frames to g_pPlayBuffer using all mix threads (audio thread)
 static bool Play(); //Replay one frame of audio
 static bool Record(); //Record one frame of audio
 static bool LoadProject(string sName); //Loads a project called sName
 static bool SaveProject(string sName = ""); //Loads a project called sName
-static void WriteHeader(unsigned int nWaveSize); //Writes the RIFF header
+static void WriteHeader(int fd, int nChannels, unsigned int nWaveSize); //Writes the RIFF header
+static void UpdateHeader(); //Write RIFF and data sizes, converting to RF64 when they exceed 32-bit
 
 //Global variables
 static int g_nChannels; //Number of channels in replay file
-//!@todo Make quantity of tracks dynamic
-static Track g_track[MAX_TRACKS]; //Array of track classes
+static Track g_track[MAX_CHANNELS]; //Array of track classes (user interface thread)
+static TripleBuffer<MixerSnapshot> g_mixer; //Mixer state passed from user interface to audio thread
+alignas(16) static int16_t g_pTargetGainA[MAX_CHANNELS]; //Gain of each track to A-leg output with recording tracks muted (audio thread)
+alignas(16) static int16_t g_pTargetGainB[MAX_CHANNELS]; //Gain of each track to B-leg output with recording tracks muted (audio thread)
+alignas(16) static int16_t g_pGainA[MAX_CHANNELS]; //Gain of each track to A-leg output at end of period being mixed - target gain faded by transport (audio thread)
+alignas(16) static int16_t g_pGainB[MAX_CHANNELS]; //Gain of each track to B-leg output at end of period being mixed (audio thread)
+alignas(16) static int16_t g_pRampGainA[MAX_CHANNELS]; //Gain of each track to A-leg output at start of period being mixed whilst g_bRamp (audio thread)
+alignas(16) static int16_t g_pRampGainB[MAX_CHANNELS]; //Gain of each track to B-leg output at start of period being mixed whilst g_bRamp (audio thread)
+static bool g_bMixChanged = false; //True if target gains or transport fade changed since last period was mixed (audio thread)
+static bool g_bRamp = false; //True if gains ramp from g_pRampGain to g_pGain during period being mixed - all channels mixed (audio thread)
+static int g_nFadeFrames = 0; //Duration of transport fade in frames (0 = none)
+static int g_nFadePos = 0; //Position in transport fade in frames (0 = silent, g_nFadeFrames = full gain) (audio thread)
+static int g_nFadeDir = 0; //Direction of transport fade (1 = fading in, -1 = fading out, 0 = none) (audio thread)
+static int g_pActive[MAX_CHANNELS]; //Index of each channel to mix - all channels unless few are audible (audio thread)
+static int g_nActive = 0; //Quantity of channels in g_pActive
+static bool g_bCompact = false; //True if g_pActive lists only audible channels so they must be gathered from each frame
+alignas(16) static int16_t g_pActiveGainA[MAX_CHANNELS]; //A-leg gain of each channel in g_pActive
+alignas(16) static int16_t g_pActiveGainB[MAX_CHANNELS]; //B-leg gain of each channel in g_pActive
+static bool g_bFloat = false; //True to mix with 32-bit float rather than 16-bit integer
+alignas(32) static float g_pTargetFloatGainA[MAX_CHANNELS]; //Float mix gain of each track to A-leg output with recording tracks muted (audio thread)
+alignas(32) static float g_pTargetFloatGainB[MAX_CHANNELS]; //Float mix gain of each track to B-leg output with recording tracks muted (audio thread)
+alignas(32) static float g_pFloatGainA[MAX_CHANNELS]; //Float mix gain of each track to A-leg output at end of period being mixed (audio thread)
+alignas(32) static float g_pFloatGainB[MAX_CHANNELS]; //Float mix gain of each track to B-leg output at end of period being mixed (audio thread)
+alignas(32) static float g_pRampFloatGainA[MAX_CHANNELS]; //Float mix gain of each track to A-leg output at start of period being mixed whilst g_bRamp (audio thread)
+alignas(32) static float g_pRampFloatGainB[MAX_CHANNELS]; //Float mix gain of each track to B-leg output at start of period being mixed whilst g_bRamp (audio thread)
+alignas(32) static float g_pActiveFloatGainA[MAX_CHANNELS]; //Float mix A-leg gain of each channel in g_pActive
+alignas(32) static float g_pActiveFloatGainB[MAX_CHANNELS]; //Float mix B-leg gain of each channel in g_pActive
+alignas(64) static float g_pFloatFrames[PERIOD_SIZE * MAX_CHANNELS]; //Period of frames converted to float for float mix - each mix group converts its own channels
 static int g_nSamplerate = SAMPLERATE; //Samples per second
 static int g_nFrameSize; //Frame size - size of a single sample of all channels (sample size x quantity of channels)
 static int g_nPeriodSize; //Period size - size of all samples in each period (sample size x quantity of channels x PERIOD_SIZE)
 static char* g_pSilence; //Pointer to one period of silent samples
 //Transport control
-static int g_nRecA; //Which track is recording A-leg input (-1 = none)
-static int g_nRecB; //Which track is recording B-leg input (-1 = none)
-static int g_nTransport; //Transport control status
-static bool g_bRecordEnabled; //True if recording enabled
+//Audio thread owns these values - user interface reads them and sends commands to change them
+static atomic<int> g_nRecA; //Which track is recording A-leg input (-1 = none)
+static atomic<int> g_nRecB; //Which track is recording B-leg input (-1 = none)
+static atomic<int> g_nTransport; //Transport control status
+static atomic<bool> g_bRecordEnabled; //True if recording enabled
 //Tape position (in blocks - one block is one sample of all tracks)
-static long g_lHeadPos; //Position of 'play head' in frames
-static int g_nLastFrame; //Last frame
-static int g_nRecordOffset; //Quantity of frames delay between replay and record
-static unsigned int g_nUnderruns; //Quantity of replay buffer underruns
-static unsigned int g_nOverruns; //Quantity of record buffer overruns
+static atomic<int64_t> g_lHeadPos; //Position of 'play head' in frames
+static atomic<int64_t> g_nLastFrame; //Last frame
+static atomic<int> g_nRecordOffset; //Quantity of frames delay between replay and record, measured when devices start
+static bool g_bLinked = false; //True if replay and record devices are linked to start and stop together
+static bool g_bPriming = false; //True whilst filling replay buffer before starting devices
+static int64_t g_nStartRequested = 0; //Time of last transport start request (microseconds) until its first audio is queued, else 0
+static atomic<int> g_nStartLatency; //Microseconds from last transport start request until its first audio was heard
+static atomic<unsigned int> g_nUnderruns; //Quantity of replay buffer underruns
+static atomic<unsigned int> g_nOverruns; //Quantity of record buffer overruns
+static atomic<int> g_nReplayError; //Last replay device error (0 = none)
+static atomic<int> g_nRecordError; //Last record device error (0 = none)
+static atomic<unsigned int> g_nDiskUnderruns; //Quantity of periods where read-ahead data was not ready
+static atomic<unsigned int> g_nDiskOverruns; //Quantity of recorded periods discarded because disk writes were not keeping up
+//Audio thread
+static SpscQueue<EngineCommand, COMMAND_QUEUE_SIZE> g_queueCommands; //Commands from user interface to audio thread
+static atomic<bool> g_bEngineRunning; //True whilst audio thread is running
+static thread g_threadEngine; //Audio thread
+static thread g_threadPrefetch; //Disk read-ahead thread
+static thread g_threadWriter; //Disk write-behind thread
+static int g_fdEngineWake = -1; //Event used to wake audio thread when commands are queued
+static int g_fdUiWake = -1; //Event used to wake user interface when audio thread changes state
+//Real-time mode
+static bool g_bRealtime = false; //True to run audio thread with real-time priority and locked memory
+static int g_nRtPriority = RT_PRIORITY; //SCHED_FIFO priority of audio thread
+static atomic<int> g_nRtError; //Error setting audio thread priority (0 = none)
+static int g_nLockError; //Error locking memory (0 = none)
+//Period timing
+static TimingHistogram g_aTiming[PHASES]; //Duration of each phase of each period
+static int64_t g_aCycleTime[PHASES]; //Duration of each phase in current audio thread cycle (audio thread)
+static int64_t g_nPeriodTime; //Duration of one period in microseconds - deadline for each audio thread cycle
+//Parallel mixdown
+static int g_nMixKernel; //Index in g_aMixKernels of fastest mix kernels for this CPU, selected by SelectMixKernel
+static MergeKernel g_pMergeKernel; //Record merge kernel for project's quantity of channels, selected by SelectFrameKernels
+static PackKernel g_pPackKernel; //Bus sum and saturate function for this CPU, selected by SelectMixKernel
+static ConvertKernel g_pConvertKernel; //16-bit to float conversion function for this CPU, selected by SelectMixKernel
+static FloatMixKernel g_pFloatMixKernel; //Float mix kernel for this CPU, selected by SelectMixKernel
+static FloatPackKernel g_pFloatPackKernel; //Float bus sum and conversion function for this CPU, selected by SelectMixKernel
+static MeterKernel g_pMeterKernel; //Metering function for this CPU, selected by SelectMixKernel
+static const float* g_apFloatBuses[MAX_MIX_THREADS]; //Partial float bus of each track group
+static int g_nCompactRatio = 1; //Mix audible channels alone when at most 1 / g_nCompactRatio of channels are audible, selected by SelectMixKernel
+static const int32_t* g_apMixBuses[MAX_MIX_THREADS]; //Partial bus of each track group
+static int g_nMixThreads = 0; //Quantity of threads mixing each period, including audio thread (0 = one per CPU core)
+static int g_nMixGroups = 1; //Quantity of track groups mixed in parallel - group 0 is mixed by audio thread
+static MixGroup g_aMixGroups[MAX_MIX_THREADS]; //Track groups, one per mix thread
+static thread g_aMixThreads[MAX_MIX_THREADS]; //Mix threads (index 0 unused - audio thread mixes group 0)
+static atomic<bool> g_bMixRunning; //True whilst mix threads are running
+static atomic<unsigned int> g_nMixPeriod; //Incremented by audio thread for each period to mix
+static atomic<int> g_nMixPending; //Quantity of mix threads still mixing current period
+static atomic<bool> g_bMixWaiting; //True whilst audio thread is waiting for g_fdMixDone
+static int g_fdMixDone = -1; //Event used to wake audio thread when mix threads finish
+static const unsigned char* g_pMixFrames; //Frames of period being mixed
+static int g_nMixFrames; //Quantity of frames in period being mixed
+//Metering
+static TripleBuffer<MeterSnapshot> g_meters; //Meter readings passed from audio thread to user interface
+alignas(16) static int16_t g_pMeterPeak[MAX_CHANNELS]; //Largest magnitude of each track since last snapshot - each mix group meters its own tracks
+alignas(16) static float g_pMeterSquares[MAX_CHANNELS]; //Sum of squares of each track's metered samples since last snapshot
+alignas(16) static int16_t g_pBusPeak[2 * METER_BUS_FRAMES]; //Largest magnitude of output since last snapshot, A-leg in even entries, B-leg in odd (audio thread)
+alignas(16) static float g_pBusSquares[2 * METER_BUS_FRAMES]; //Sum of squares of metered output samples since last snapshot, A-leg in even entries, B-leg in odd (audio thread)
+static int16_t g_pInputPeak[2]; //Largest magnitude of each capture leg since last snapshot (audio thread)
+static bool g_pInputClipping[2]; //True if last period captured on each leg reached full scale (audio thread)
+static atomic<unsigned int> g_aInputClips[2]; //Quantity of overloads (runs of periods reaching full scale) captured on each leg
+static int g_nMeterFrames = 0; //Quantity of frames metered since last snapshot (audio thread)
+static int g_nMeterPeriod = 0; //Quantity of periods since last snapshot (audio thread)
+static int g_nMeterPeriods = METER_INTERVAL; //Quantity of periods between snapshots (multiple of METER_INTERVAL)
+static bool g_bMeterPeriod = false; //True if period being mixed is metered
+static bool g_pClip[MAX_CHANNELS]; //True if track has reached full scale since clips were cleared (user interface thread)
+static bool g_pBusClip[2]; //True if output has reached full scale since clips were cleared (user interface thread)
+static int16_t g_pInputHold[2]; //Input peak held on each capture leg's meter (user interface thread)
+static int64_t g_pInputHoldTime[2]; //Time input peak was held (microseconds, user interface thread)
+//Input monitoring
+static bool g_bMonitor = false; //True to mix captured input to replay output - each captured period is replayed in the same cycle
+static Track g_aMonitor[2]; //Monitor level and pan of A-leg and B-leg input (user interface thread)
+static int16_t g_pTargetMonitorA[2]; //Gain of each input leg to A-leg output (audio thread)
+static int16_t g_pTargetMonitorB[2]; //Gain of each input leg to B-leg output (audio thread)
+static int16_t g_pMonitorA[2]; //Gain of each input leg to A-leg output at end of last monitored period - target gain faded by transport (audio thread)
+static int16_t g_pMonitorB[2]; //Gain of each input leg to B-leg output at end of last monitored period (audio thread)
+static int g_nMonitorFrames = 0; //Quantity of frames in g_pRecBuffer not yet monitored (audio thread)
+//Disk read-ahead
+static BlockRing g_ringPrefetch; //Periods of audio read ahead of play head
+static float g_fPrefetchSeconds = PREFETCH_SECONDS; //Duration of audio to read ahead of play head
+static int g_nFadeMs = FADE_MS; //Duration of monitor fade in / out when transport starts / stops (milliseconds, 0 = none)
+static int g_nPrefetchChunk; //Quantity of periods in each disk read
+static int g_fdPrefetchWake = -1; //Event used to wake disk read-ahead thread
+static atomic<bool> g_bPrefetchRunning; //True whilst disk read-ahead thread is running
+static atomic<int64_t> g_lPrefetchFrom; //Frame to read ahead from after a seek request
+static atomic<unsigned int> g_nPrefetchRequest; //Seek request id - incremented by audio thread for each seek
+static atomic<unsigned int> g_nPrefetchAck; //Seek request id last actioned by disk thread
+static atomic<int> g_nPrefetchFlush; //Ring index of first block read after last seek
+static atomic<unsigned int> g_nPrefetchEnd; //Seek request id for which end of file has been read
+static unsigned int g_nPrefetchFlushed; //Seek request id for which audio thread has discarded stale blocks
+static int64_t g_lPrefetchNext = -1; //Frame at start of next period in read-ahead buffer (audio thread)
+//Memory-mapped replay
+static bool g_bMmap = false; //True to replay directly from a mapping of the WAVE file rather than copying it to read-ahead ring
+static atomic<unsigned char*> g_pMapData; //Start of WAVE data in current mapping (NULL if not mapped - replay from read-ahead ring)
+static atomic<unsigned char*> g_pMapSeen; //Start of WAVE data in mapping last used by audio thread - previous mapping is unused once this is current
+static unsigned char* g_pMapBase = NULL; //Start of current mapping (page aligned)
+static size_t g_nMapSize = 0; //Size of current mapping
+static off_t g_offMap = 0; //Offset in file of start of current mapping (page aligned)
+static unsigned char* g_pMapOld = NULL; //Start of previous mapping waiting to be unmapped (disk thread)
+static size_t g_nMapOldSize = 0; //Size of previous mapping
+static atomic<int64_t> g_lMapReady; //Frame up to which mapped data is resident ahead of play head
+static atomic<int64_t> g_lMapHead; //Frame at start of next period to replay from mapping
+//Disk write-behind
+static BlockRing g_ringWrite; //Periods of recorded frames (tagged with frame position and armed tracks) waiting to be written to disk
+static int g_nWriteChunk; //Quantity of periods in each disk write
+static int g_fdWriteWake = -1; //Event used to wake disk write-behind thread
+static atomic<bool> g_bWriterRunning; //True whilst disk write-behind thread is running
+static atomic<bool> g_bWriteFlush; //True to request disk write-behind thread writes all queued data
+static off_t g_offDs64 = 0; //Offset of chunk reserved for RF64 ds64 chunk (JUNK or ds64 immediately after WAVE id, 0 if none)
+static uint32_t g_nDs64Size = 0; //Size of chunk reserved for ds64 chunk
+static bool g_bRf64 = false; //True if WAVE file is RF64 (sizes in ds64 chunk)
+static off_t g_offAllocated = 0; //Offset of end of file space allocated for recording (disk write-behind thread)
+//Planar storage
+static bool g_bPlanar = false; //True to store project as one mono WAVE file per track rather than one interleaved WAVE file
+static int g_afdTrack[MAX_CHANNELS]; //File descriptor of each track's WAVE file (-1 if not open)
+static off_t g_aoffTrackEnd[MAX_CHANNELS]; //Offset of end of data in each track's file (disk write-behind thread)
+static off_t g_aoffTrackAllocated[MAX_CHANNELS]; //Offset of end of file space allocated in each track's file (disk write-behind thread)
+static atomic<uint64_t> g_nPlanarMask; //Bit for each track read ahead - audible and armed tracks (other tracks read as silence)
+static bool g_bPrefetchReread = false; //True if tracks that were not read ahead have become audible so read-ahead data is stale (audio thread)
+static unsigned char* g_pPlanarRead = NULL; //One track's samples of each disk read (disk read-ahead thread)
+static unsigned char* g_pPlanarWrite = NULL; //One track's samples of each disk write (disk write-behind thread)
+static int g_nStorageTask = 0; //Planar storage task requested by user (STORAGE_IMPORT or STORAGE_EXPORT, 0 = none)
+//Recording (audio thread only)
+static unsigned char* g_pHistory; //Ring of replayed frames, indexed by frame position, merged with recorded audio
+static int g_nHistoryFrames; //Quantity of frames in g_pHistory
+static int64_t g_lHistoryStart; //Frame position of first valid frame in g_pHistory
+static int64_t g_lHistoryEnd; //Frame position after last valid frame in g_pHistory
+static int64_t g_lRecordPos; //Frame position of next recorded frame
 //file system
 static string g_sPath; //Path to project
 static string g_sProject; //Project name
@@ -158,14 +1095,15 @@ static string g_sPcmRecName = "default";
 WINDOW* g_pWindowRouting; //Pointer to ncurses window
 //File offsets (in bytes)
 static off_t g_offStartOfData; //Offset of data in wave file
-static off_t g_offEndOfData; //Offset of end of data in wave file (end of file)
+static atomic<off_t> g_offEndOfData; //Offset of end of data in wave file (end of file)
 //General application
 static bool g_bLoop; //True whilst main loop is running
 static int g_fdWave; //File descriptor of replay file
 static int g_nSelectedTrack; //Index of selected track
+static int g_nFirstTrack = 0; //Index of first track shown in routing window - scrolls to keep selected track shown
 int g_nDebug; //General purpose debug integer
-static unsigned char* g_pReadBuffer; //Buffer to hold data read from file
 static int16_t g_pPlayBuffer[PERIOD_SIZE * 2]; //Buffer to hold data to be written to audio output device
+alignas(16) static unsigned char g_pRecBuffer[2 * SAMPLESIZE * PERIOD_SIZE]; //Buffer to hold period read from audio input device
 
 /** Structure representing RIFF WAVE format chunk header (without id or size, i.e. 8 bytes smaller) **/
 struct WaveHeader
@@ -180,11 +1118,40 @@ struct WaveHeader
 
 void ShowMenu()
 {
-    for(int i = 0; i < g_nChannels; ++i)
+    if(g_meters.Update())
+    {
+        //Latch clips until cleared so that a brief overload is not missed
+        const MeterSnapshot& meters = g_meters.GetReadBuffer();
+        for(int i = 0; i < g_nChannels; ++i)
+            g_pClip[i] = g_pClip[i] || meters.pPeak[i] >= METER_CLIP;
+        int64_t nNow = GetMicroseconds();
+        for(int nLeg = 0; nLeg < 2; ++nLeg)
+        {
+            g_pBusClip[nLeg] = g_pBusClip[nLeg] || meters.pBusPeak[nLeg] >= METER_CLIP;
+            //Hold each input peak until a higher peak or hold time expires
+            if(meters.pInputPeak[nLeg] >= g_pInputHold[nLeg] || nNow - g_pInputHoldTime[nLeg] > METER_HOLD_MS * 1000)
+            {
+                g_pInputHold[nLeg] = meters.pInputPeak[nLeg];
+                g_pInputHoldTime[nLeg] = nNow;
+            }
+        }
+    }
+    const MeterSnapshot& meters = g_meters.GetReadBuffer();
+    bool bRolling = (TC_STOP != g_nTransport); //Readings are not refreshed whilst stopped
+    //Routing window shows MAX_TRACKS tracks, scrolled to selected track
+    if(g_nSelectedTrack < g_nChannels)
+    {
+        if(g_nSelectedTrack < g_nFirstTrack)
+            g_nFirstTrack = g_nSelectedTrack;
+        else if(g_nSelectedTrack >= g_nFirstTrack + MAX_TRACKS)
+            g_nFirstTrack = g_nSelectedTrack - MAX_TRACKS + 1;
+    }
+    g_nFirstTrack = max(0, min(g_nFirstTrack, g_nChannels - MAX_TRACKS));
+    for(int i = g_nFirstTrack; i < min(g_nChannels, g_nFirstTrack + MAX_TRACKS); ++i)
     {
         if((int)i == g_nSelectedTrack)
             wattron(g_pWindowRouting, COLOR_PAIR(WHITE_BLUE));
-        mvwprintw(g_pWindowRouting, i, 0, "Track %02d: ", i + 1);
+        mvwprintw(g_pWindowRouting, i - g_nFirstTrack, 0, "Track %02d: ", i + 1);
         wattroff(g_pWindowRouting, COLOR_PAIR(WHITE_BLUE));
         if((int)i == g_nRecA)
         {
@@ -202,16 +1169,28 @@ void ShowMenu()
         }
         else
             wprintw(g_pWindowRouting, "      ");
-        if(g_track[i].bMute)
-        {
-            wattron(g_pWindowRouting, COLOR_PAIR(RED_BLACK));
-            wprintw(g_pWindowRouting, "     MUTE    ", g_track[i].nMonMixA, g_track[i].nMonMixB);
-            wattroff(g_pWindowRouting, COLOR_PAIR(RED_BLACK));
-        }
-        else
-            wprintw(g_pWindowRouting, " %s  %s", MIX_LEVEL[g_track[i].nMonMixA].c_str(), MIX_LEVEL[g_track[i].nMonMixB].c_str());
+        ShowLevel(g_pWindowRouting, g_track[i]);
+        ShowMeter(g_pWindowRouting, bRolling ? meters.pPeak[i] : 0, bRolling ? meters.pPower[i] : 0, g_pClip[i]);
     }
     wrefresh(g_pWindowRouting);
+    mvprintw(MAX_TRACKS + 1, 0, "Output A: ");
+    ShowMeter(stdscr, bRolling ? meters.pBusPeak[0] : 0, bRolling ? meters.pBusPower[0] : 0, g_pBusClip[0]);
+    printw("  B: ");
+    ShowMeter(stdscr, bRolling ? meters.pBusPeak[1] : 0, bRolling ? meters.pBusPower[1] : 0, g_pBusClip[1]);
+    for(int nLeg = 0; nLeg < 2; ++nLeg)
+    {
+        //Input meter bar shows peak level with a mark at held peak
+        float fPeak = bRolling ? meters.pInputPeak[nLeg] / FLOAT_SCALE : 0;
+        unsigned int nClips = g_aInputClips[nLeg];
+        if(g_nChannels + nLeg == g_nSelectedTrack)
+            attron(COLOR_PAIR(WHITE_BLUE));
+        mvprintw(11 + nLeg, 54, "Input %c: ", 'A' + nLeg);
+        attroff(COLOR_PAIR(WHITE_BLUE));
+        ShowMeter(stdscr, bRolling ? g_pInputHold[nLeg] : 0, fPeak * fPeak, nClips > 0);
+        printw(" %u clip%s  ", nClips, 1 == nClips ? "" : "s");
+        if(g_bMonitor)
+            ShowLevel(stdscr, g_aMonitor[nLeg]);
+    }
     switch(g_nTransport)
     {
         case TC_STOP:
@@ -240,264 +1219,345 @@ void ShowMenu()
     refresh();
 }
 
+void ShowMeter(WINDOW* pWindow, int nPeak, float fPower, bool bClip)
+{
+    //Bar shows power (RMS level) with a mark at peak level, each character METER_RANGE / METER_WIDTH dB
+    char sBar[METER_WIDTH + 1];
+    int nPower = 0;
+    if(fPower > 0)
+        nPower = max(0, min(METER_WIDTH, (int)((10 * log10f(fPower) + METER_RANGE) * METER_WIDTH / METER_RANGE)));
+    int nPeakChars = 0;
+    if(nPeak > 0)
+        nPeakChars = max(0, min(METER_WIDTH, (int)ceilf((20 * log10f(nPeak / FLOAT_SCALE) + METER_RANGE) * METER_WIDTH / METER_RANGE)));
+    for(int nChar = 0; nChar < METER_WIDTH; ++nChar)
+        sBar[nChar] = (nChar < nPower) ? '=' : ' ';
+    if(nPeakChars)
+        sBar[nPeakChars - 1] = '|';
+    sBar[METER_WIDTH] = 0;
+    waddch(pWindow, '[');
+    if(bClip)
+        wattron(pWindow, COLOR_PAIR(WHITE_RED));
+    wprintw(pWindow, "%s", sBar);
+    wattroff(pWindow, COLOR_PAIR(WHITE_RED));
+    waddch(pWindow, ']');
+}
+
+void ShowLevel(WINDOW* pWindow, const Track& track)
+{
+    if(track.bMute)
+    {
+        wattron(pWindow, COLOR_PAIR(RED_BLACK));
+        wprintw(pWindow, "     MUTE      ");
+        wattroff(pWindow, COLOR_PAIR(RED_BLACK));
+        return;
+    }
+    char sPan[16] = " C ";
+    if(track.nPan)
+        snprintf(sPan, sizeof(sPan), "%c%02d", track.nPan < 0 ? 'L' : 'R', abs(track.nPan));
+    if(LEVEL_STEPS == track.nLevel)
+        wprintw(pWindow, "   -Inf   %s ", sPan);
+    else
+        wprintw(pWindow, " %6.1fdB  %s ", track.nLevel * -0.5, sPan);
+}
+
 void ShowHeadPosition()
 {
     attron(COLOR_PAIR(WHITE_MAGENTA));
-    unsigned int nMinutes = g_lHeadPos / g_nSamplerate / 60;
-    unsigned int nSeconds = (g_lHeadPos - nMinutes * g_nSamplerate * 60) / g_nSamplerate;
-    unsigned int nMillis = (g_lHeadPos - (nMinutes * 60 + nSeconds) * g_nSamplerate) * 1000 / 44100;
+    int64_t lHeadPos = g_lHeadPos;
+    unsigned int nMinutes = lHeadPos / g_nSamplerate / 60;
+    unsigned int nSeconds = (lHeadPos - nMinutes * g_nSamplerate * 60) / g_nSamplerate;
+    unsigned int nMillis = (lHeadPos - (nMinutes * 60 + nSeconds) * g_nSamplerate) * 1000 / g_nSamplerate;
     mvprintw(0, 0, "Position: %02d:%02d.%03d ", nMinutes, nSeconds, nMillis);
     attroff(COLOR_PAIR(WHITE_MAGENTA));
 }
 
-void HandleControl()
+void ShowStatus()
 {
-    int nInput = getch();
-    switch(nInput)
+    if(g_nRecordOffset)
+        mvprintw(20, 0, "Record offset: %d frames   ", (int)g_nRecordOffset);
+    if(g_nStartLatency)
+        mvprintw(20, 30, "Start latency: %.1fms   ", g_nStartLatency / 1000.0);
+    attron(COLOR_PAIR(WHITE_RED));
+    if(g_nUnderruns)
+        mvprintw(18, 0, "Underruns:% 4d", (unsigned int)g_nUnderruns);
+    if(-ESTRPIPE == g_nReplayError)
+        mvprintw(18, 12, "Streams pipe error");
+    else if(-EBADFD == g_nReplayError)
+        mvprintw(18, 31, "File descriptor in bad state");
+    if(g_nOverruns)
+        mvprintw(19, 0, "Overruns:% 4d ", (unsigned int)g_nOverruns);
+    if(-ESTRPIPE == g_nRecordError)
+        mvprintw(19, 12, "Streams pipe error");
+    else if(-EBADFD == g_nRecordError)
+        mvprintw(19, 31, "File descriptor in bad state");
+    if(g_nDiskUnderruns)
+        mvprintw(21, 0, "Disk underruns:% 4d", (unsigned int)g_nDiskUnderruns);
+    if(g_nDiskOverruns)
+        mvprintw(21, 20, "Disk overruns:% 4d", (unsigned int)g_nDiskOverruns);
+    if(g_bRealtime && g_nRtError)
+        mvprintw(22, 0, "Real-time priority %d refused: %s (check rtprio limit)", g_nRtPriority, strerror(g_nRtError));
+    if(g_bRealtime && g_nLockError)
+        mvprintw(23, 0, "Memory lock failed: %s (check memlock limit)", strerror(g_nLockError));
+    attroff(COLOR_PAIR(WHITE_RED));
+}
+
+void FormatTiming(int nPhase, char* pBuffer, size_t nSize)
+{
+    const TimingHistogram& timing = g_aTiming[nPhase];
+    snprintf(pBuffer, nSize, "%-7s %6lld %6lld %6lld %5u %5u", PHASE_NAME[nPhase], (long long)timing.GetPercentile(50),
+        (long long)timing.GetPercentile(99), (long long)timing.GetMax(), timing.GetMisses(), timing.GetBlamed());
+}
+
+void ShowTiming()
+{
+    char pBuffer[64];
+    mvprintw(1, 54, "Period timing (us, deadline %lld)", (long long)g_nPeriodTime);
+    mvprintw(2, 54, "%s", TIMING_HEADER);
+    for(int nPhase = 0; nPhase < PHASES; ++nPhase)
     {
-        case 'q':
-            //Quit
-            //!@todo Confirm quit
-            g_bLoop = false;
-            break;
-        case 'o':
-            //Open project
-            //!@todo Implement open project
-            break;
-        case KEY_DOWN:
-            //Select next track
-            if(++g_nSelectedTrack >= g_nChannels)
-                g_nSelectedTrack = g_nChannels - 1;
-            break;
-        case KEY_UP:
-            //Select previou track
-            if(--g_nSelectedTrack < 0)
-                g_nSelectedTrack = 0;
-            break;
-        case KEY_RIGHT:
-            //Increase monitor level
-            if(g_track[g_nSelectedTrack].bMute)
-                g_track[g_nSelectedTrack].bMute = false;
-            else
-            {
-                if(g_track[g_nSelectedTrack].nMonMixA > 0)
-                    --g_track[g_nSelectedTrack].nMonMixA;
-                if(g_track[g_nSelectedTrack].nMonMixB > 0)
-                    --g_track[g_nSelectedTrack].nMonMixB;
-            }
+        FormatTiming(nPhase, pBuffer, sizeof(pBuffer));
+        if(g_aTiming[nPhase].GetBlamed())
+            attron(COLOR_PAIR(WHITE_RED));
+        mvprintw(3 + nPhase, 54, "%s", pBuffer);
+        attroff(COLOR_PAIR(WHITE_RED));
+    }
+}
+
+int64_t GetMicroseconds()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void SendCommand(int nCommand, int64_t lValue)
+{
+    EngineCommand command;
+    command.nCommand = nCommand;
+    command.lValue = lValue;
+    command.nQueued = GetMicroseconds();
+    if(!g_queueCommands.Push(command))
+        beep(); //Audio thread not keeping up with user - drop command
+    eventfd_write(g_fdEngineWake, 1);
+}
+
+Track& GetSelectedTrack()
+{
+    //Monitored inputs are selected below last track
+    if(g_nSelectedTrack >= g_nChannels)
+        return g_aMonitor[g_nSelectedTrack - g_nChannels];
+    return g_track[g_nSelectedTrack];
+}
+
+void AdjustLevel(int nSteps)
+{
+    Track& track = GetSelectedTrack();
+    if(track.bMute)
+        track.bMute = false;
+    else
+        track.nLevel = max(0, min(LEVEL_STEPS, track.nLevel + nSteps));
+}
+
+void AdjustPan(int nSteps)
+{
+    Track& track = GetSelectedTrack();
+    if(track.bMute)
+        track.bMute = false;
+    else
+        track.nPan = max(-PAN_STEPS, min(PAN_STEPS, track.nPan + nSteps));
+}
+
+void SetPan(int nPan, int nLevel)
+{
+    Track& track = GetSelectedTrack();
+    track.bMute = false;
+    track.nPan = nPan;
+    track.nLevel = nLevel;
+}
+
+int GetMixPad()
+{
+    //Each doubling of track count needs 6dB more attenuation
+    int nPad = 0;
+    while((1 << nPad) < g_nChannels && nPad < 16)
+        ++nPad;
+    return nPad;
+}
+
+bool HandleControl()
+{
+    int nInput = getch();
+    if(ERR == nInput)
+        return false; //No more input
+    switch(nInput)
+    {
+        case 'q':
+            //Quit
+            //!@todo Confirm quit
+            g_bLoop = false;
+            break;
+        case 'o':
+            //Open project
+            //!@todo Implement open project
+            break;
+        case KEY_DOWN:
+            //Select next track
+            if(++g_nSelectedTrack >= g_nChannels + (g_bMonitor ? 2 : 0))
+                g_nSelectedTrack = g_nChannels + (g_bMonitor ? 1 : -1); //Monitored inputs follow last track
+            break;
+        case KEY_UP:
+            //Select previou track
+            if(--g_nSelectedTrack < 0)
+                g_nSelectedTrack = 0;
+            break;
+        case KEY_RIGHT:
+            //Increase monitor level
+            AdjustLevel(-1);
             break;
         case KEY_LEFT:
             //Decrease monitor level
-            if(g_track[g_nSelectedTrack].bMute)
-                g_track[g_nSelectedTrack].bMute = false;
-            else
-            {
-                if(g_track[g_nSelectedTrack].nMonMixA < 16)
-                    ++g_track[g_nSelectedTrack].nMonMixA;
-                if(g_track[g_nSelectedTrack].nMonMixB < 16)
-                    ++g_track[g_nSelectedTrack].nMonMixB;
-            }
+            AdjustLevel(1);
+            break;
+        case KEY_PPAGE:
+            //Increase monitor level by 6dB
+            AdjustLevel(-LEVEL_STEPS_6DB);
+            break;
+        case KEY_NPAGE:
+            //Decrease monitor level by 6dB
+            AdjustLevel(LEVEL_STEPS_6DB);
             break;
         case KEY_SRIGHT:
             //Pan monitor right
-            if(g_track[g_nSelectedTrack].bMute)
-                g_track[g_nSelectedTrack].bMute = false;
-            else
-            {
-                if(g_track[g_nSelectedTrack].nMonMixA < 16)
-                    ++g_track[g_nSelectedTrack].nMonMixA;
-                if(g_track[g_nSelectedTrack].nMonMixB > 0)
-                    --g_track[g_nSelectedTrack].nMonMixB;
-            }
+            AdjustPan(1);
             break;
         case KEY_SLEFT:
             //Pan monitor left
-            if(g_track[g_nSelectedTrack].bMute)
-                g_track[g_nSelectedTrack].bMute = false;
-            else
-            {
-                if(g_track[g_nSelectedTrack].nMonMixA > 0)
-                    --g_track[g_nSelectedTrack].nMonMixA;
-                if(g_track[g_nSelectedTrack].nMonMixB < 16)
-                    ++g_track[g_nSelectedTrack].nMonMixB;
-            }
+            AdjustPan(-1);
             break;
         case 'L':
             //Pan fully left
-            if(g_track[g_nSelectedTrack].bMute)
-                g_track[g_nSelectedTrack].bMute = false;
-            g_track[g_nSelectedTrack].nMonMixA = 0;
-            g_track[g_nSelectedTrack].nMonMixB = 16;
+            SetPan(-PAN_STEPS, 0);
             break;
         case 'R':
             //Pan fully right
-            if(g_track[g_nSelectedTrack].bMute)
-                g_track[g_nSelectedTrack].bMute = false;
-            g_track[g_nSelectedTrack].nMonMixA = 16;
-            g_track[g_nSelectedTrack].nMonMixB = 0;
+            SetPan(PAN_STEPS, 0);
+            break;
+        case 'C':
+            //Pan centre
+            SetPan(0, 0);
             break;
         case 'l':
             //Pan fully left and pad to fit track count
-            if(g_track[g_nSelectedTrack].bMute)
-                g_track[g_nSelectedTrack].bMute = false;
-            g_track[g_nSelectedTrack].nMonMixA = 4;
-            g_track[g_nSelectedTrack].nMonMixB = 16;
+            SetPan(-PAN_STEPS, GetMixPad() * LEVEL_STEPS_6DB);
             break;
         case 'r':
             //Pan fully right and pad to fit track count
-            if(g_track[g_nSelectedTrack].bMute)
-                g_track[g_nSelectedTrack].bMute = false;
-            g_track[g_nSelectedTrack].nMonMixA = 16;
-            g_track[g_nSelectedTrack].nMonMixB = 4;
-            break;
-        case 'C':
-            //Pan centre
-            if(g_track[g_nSelectedTrack].bMute)
-                g_track[g_nSelectedTrack].bMute = false;
-            g_track[g_nSelectedTrack].nMonMixA = 1;
-            g_track[g_nSelectedTrack].nMonMixB = 1;
+            SetPan(PAN_STEPS, GetMixPad() * LEVEL_STEPS_6DB);
             break;
         case 'c':
             //Pan centre and pad to fit track count
-            if(g_track[g_nSelectedTrack].bMute)
-                g_track[g_nSelectedTrack].bMute = false;
-            g_track[g_nSelectedTrack].nMonMixA = 4; //!@todo should work out from g_nChannels
-            g_track[g_nSelectedTrack].nMonMixB = 4;
+            SetPan(0, GetMixPad() * LEVEL_STEPS_6DB);
             break;
         case 'a':
             //Toggle record from A
-            if(g_nRecA == g_nSelectedTrack)
-            {
-                g_track[g_nRecA].bRecording = false;
-                g_nRecA = -1;
-            }
-            else
-            {
-                if(g_nRecA > -1)
-                    g_track[g_nRecA].bRecording = false;
-                g_nRecA = g_nSelectedTrack;
-                if(g_pPcmRecord)
-                    g_track[g_nRecA].bRecording = true;
-            }
-            if((-1 == g_nRecA) && (-1 == g_nRecB))
-                CloseRecord();
+            if(g_nSelectedTrack < g_nChannels)
+                SendCommand(CMD_ARM_A, (g_nRecA == g_nSelectedTrack) ? -1 : g_nSelectedTrack);
             break;
         case 'b':
             //Toggle record from B
-            if(g_nRecB == g_nSelectedTrack)
-            {
-                g_track[g_nRecB].bRecording = false;
-                g_nRecB = -1;
-            }
-            else
-            {
-                if(g_nRecB > -1)
-                    g_track[g_nRecB].bRecording = false;
-                g_nRecB = g_nSelectedTrack;
-                if(g_pPcmRecord)
-                    g_track[g_nRecB].bRecording = true;
-            }
-            if((-1 == g_nRecA) && (-1 == g_nRecB))
-                CloseRecord();
+            if(g_nSelectedTrack < g_nChannels)
+                SendCommand(CMD_ARM_B, (g_nRecB == g_nSelectedTrack) ? -1 : g_nSelectedTrack);
             break;
         case 'm':
             //Toggle monitor mute
-            g_track[g_nSelectedTrack].bMute = !g_track[g_nSelectedTrack].bMute;
+            GetSelectedTrack().bMute = !GetSelectedTrack().bMute;
             break;
         case 'M':
-            //Toggle all monitor mute
+            //Toggle all monitor mute - all tracks or both inputs
             {
-                bool bMute = !g_track[g_nSelectedTrack].bMute;
-                for(int i = 0; i < g_nChannels; ++i)
-                    g_track[i].bMute = bMute;
+                bool bMute = !GetSelectedTrack().bMute;
+                bool bInput = (g_nSelectedTrack >= g_nChannels);
+                for(int i = 0; i < (bInput ? 2 : g_nChannels); ++i)
+                    (bInput ? g_aMonitor[i] : g_track[i]).bMute = bMute;
             }
             break;
         case ' ':
             //Start / Stop
-            switch(g_nTransport)
-            {
-                case TC_STOP:
-                    //Currently stopped so need to open files and interfaces and start
-                    if(OpenReplay())
-                        g_nTransport = TC_PLAY;
-                    //!@todo Configure whether auto return to zero when playing from end of track
-                    if(!g_bRecordEnabled && g_lHeadPos >= g_nLastFrame)
-                        g_lHeadPos = 0;
-                    SetPlayHead(g_lHeadPos);
-                    break;
-                case TC_PLAY:
-                    //Currently playing so need to stop
-                    CloseReplay();
-                    g_nTransport = TC_STOP;
-                    g_bRecordEnabled = false;
-                    CloseRecord();
-                    g_nLastFrame = (g_offEndOfData - g_offStartOfData) / g_nFrameSize; //Update file size
-                    break;
-            }
+            SendCommand((TC_STOP == g_nTransport) ? CMD_START : CMD_STOP);
             break;
         case 'G':
             //Toggle record mode
-            if(g_bRecordEnabled)
-                CloseRecord();
-            g_bRecordEnabled = !g_bRecordEnabled;
+            SendCommand(CMD_RECORD_ENABLE, !g_bRecordEnabled);
             break;
         case KEY_HOME:
             //Go to home position
-            SetPlayHead(0);
+            SendCommand(CMD_LOCATE, 0);
             break;
         case KEY_END:
             //Go to end of track
-            SetPlayHead(g_nLastFrame);
+            SendCommand(CMD_LOCATE, g_nLastFrame);
             break;
         case ',':
             //Back 1 seconds
-            SetPlayHead(g_lHeadPos - 1 * g_nSamplerate);
+            SendCommand(CMD_LOCATE, g_lHeadPos - 1 * g_nSamplerate);
             break;
         case '.':
             //Forward 1 seconds
-            SetPlayHead(g_lHeadPos + 1 * g_nSamplerate);
+            SendCommand(CMD_LOCATE, g_lHeadPos + 1 * g_nSamplerate);
             break;
         case '<':
             //Back 10 seconds
-            SetPlayHead(g_lHeadPos - 10 * g_nSamplerate);
+            SendCommand(CMD_LOCATE, g_lHeadPos - 10 * g_nSamplerate);
             break;
         case '>':
             //Forward 10 seconds
-            SetPlayHead(g_lHeadPos + 10 * g_nSamplerate);
+            SendCommand(CMD_LOCATE, g_lHeadPos + 10 * g_nSamplerate);
             break;
         case 'e':
             //Clear errors
             g_nUnderruns = 0;
             g_nOverruns = 0;
+            g_nReplayError = 0;
+            g_nRecordError = 0;
+            g_nDiskUnderruns = 0;
+            g_nDiskOverruns = 0;
+            for(int nPhase = 0; nPhase < PHASES; ++nPhase)
+                g_aTiming[nPhase].Reset();
+            memset(g_pClip, 0, sizeof(g_pClip));
+            memset(g_pBusClip, 0, sizeof(g_pBusClip));
+            g_aInputClips[0] = 0;
+            g_aInputClips[1] = 0;
             move(18, 0);
             clrtoeol();
             move(19, 0);
             clrtoeol();
+            move(21, 0);
+            clrtoeol();
             break;
-        case '+':
-            //Increase record offset
-            //!@todo Remove record offset adjustment from user interface
-            g_nRecordOffset += 100;
-            mvprintw(20,0,"Record offset: %d           ", g_nRecordOffset);
+        case 'X':
+            //Export interleaved WAVE file from track files
+            if(g_bPlanar && TC_STOP == g_nTransport)
+                g_nStorageTask = STORAGE_EXPORT;
             break;
-        case '-':
-            //Decrease record offset
-            g_nRecordOffset -= 100;
-            mvprintw(20,0,"Record offset: %d           ", g_nRecordOffset);
+        case 'I':
+            //Import track files from interleaved WAVE file
+            if(g_bPlanar && TC_STOP == g_nTransport)
+                g_nStorageTask = STORAGE_IMPORT;
             break;
         case 'z':
             //Debug
             break;
         default:
-            return; //Avoid updating menu if invalid keypress
+            return true; //Avoid updating menu if invalid keypress
     }
     ShowMenu();
+    return true;
 }
 
 //Opens WAVE file and reads header
 bool OpenFile()
 {
-    // Expect header to be 12 + 24 + 8 = 44
+    // Expect header to be 12 + 36 + 24 + 8 = 80 but adopt whatever chunks precede data
 	//**Open file**
 	if(g_fdWave < 0)
     {
@@ -515,19 +1575,21 @@ bool OpenFile()
 
         //**Read RIFF headers**
         char pBuffer[12];
-        if((read(g_fdWave, pBuffer, 12) < 12) || (0 != strncmp(pBuffer, "RIFF", 4)) || (0 != strncmp(pBuffer + 8, "WAVE", 4)))
+        g_offDs64 = 0;
+        g_bRf64 = false;
+        if((read(g_fdWave, pBuffer, 12) < 12) || (0 != strncmp(pBuffer, "RIFF", 4) && 0 != strncmp(pBuffer, "RF64", 4)) || (0 != strncmp(pBuffer + 8, "WAVE", 4)))
         {
-            //Invalid file so create a WAVE file with 4 seconds of silence
+            //Invalid file so create a WAVE file with 4 seconds of silence - extending file reads as zeros without writing them
             g_nChannels = MAX_TRACKS;
             g_nSamplerate = SAMPLERATE;
             size_t nWaveSize = g_nSamplerate * g_nChannels * SAMPLESIZE * 4;
-            WriteHeader(nWaveSize);
-            unsigned char pSilentBuffer[nWaveSize];
-            memset(pSilentBuffer, 0, nWaveSize);
-            pwrite(g_fdWave, pSilentBuffer, nWaveSize, 44);
-            ftruncate(g_fdWave, 44 + nWaveSize);
+            WriteHeader(g_fdWave, g_nChannels, nWaveSize);
+            ftruncate(g_fdWave, WAVE_HEADER_SIZE + nWaveSize);
             lseek(g_fdWave, 12, SEEK_SET);
         }
+        else
+            g_bRf64 = (0 == strncmp(pBuffer, "RF64", 4));
+        uint64_t nDs64DataSize = 0; //Size of data from ds64 chunk (0 if none)
 
         char pWaveBuffer[sizeof(WaveHeader)];
         WaveHeader* pWaveHeader = (WaveHeader*)pWaveBuffer;
@@ -537,10 +1599,24 @@ bool OpenFile()
         {
             char sId[5] = {0,0,0,0,0}; //buffer for debug output only
             strncpy(sId, pBuffer, 4); //chunk ID is first 32-bit word
-            uint32_t nSize = (uint32_t)*(pBuffer + 4); //chunk size is second 32-bit word
+            uint32_t nSize = GetLE32(pBuffer + 4); //chunk size is second 32-bit word
 
     //        cerr << endl << "Found chunk " << sId << " of size " << nSize << endl;
-            if(0 == strncmp(pBuffer, "fmt ", 4)) //chunk ID is first 32-bit word
+            off_t offChunk = lseek(g_fdWave, 0, SEEK_CUR) - 8;
+            if(12 == offChunk && nSize >= (uint32_t)DS64_SIZE && (0 == strncmp(pBuffer, "JUNK", 4) || 0 == strncmp(pBuffer, "ds64", 4)))
+            {
+                //First chunk may hold (ds64) or make room for (JUNK) RF64 sizes
+                g_offDs64 = offChunk;
+                g_nDs64Size = nSize;
+                char pDs64[DS64_SIZE];
+                if(0 == strncmp(pBuffer, "ds64", 4) && read(g_fdWave, pDs64, DS64_SIZE) == DS64_SIZE)
+                {
+                    nDs64DataSize = GetLE64(pDs64 + 8);
+                    nSize -= DS64_SIZE;
+                }
+                lseek(g_fdWave, nSize + (nSize & 1), SEEK_CUR);
+            }
+            else if(0 == strncmp(pBuffer, "fmt ", 4)) //chunk ID is first 32-bit word
             {
                 //Found format chunk
                 if(read(g_fdWave, pWaveBuffer, sizeof(pWaveBuffer)) < (int)sizeof(pWaveBuffer))
@@ -550,9 +1626,14 @@ bool OpenFile()
                     return false;
                 }
                 g_nChannels = pWaveHeader->nNumChannels;
-                if(g_nChannels > MAX_TRACKS)
+                if(0 == g_nChannels || g_nChannels > MAX_CHANNELS)
                 {
-                    //!@todo handle too many tracks, e.g. ask whether to delete extra tracks
+                    cerr << "Unable to mix " << g_nChannels << " channels (maximum " << MAX_CHANNELS << ")" << endl;
+                    close(g_fdWave);
+                    g_fdWave = -1;
+                    g_nChannels = 0; //No tracks to show or mix
+                    CloseReplay();
+                    return false;
                 }
                 g_nSamplerate = pWaveHeader->nSampleRate;
                 g_nFrameSize = g_nChannels * SAMPLESIZE;
@@ -561,334 +1642,3225 @@ bool OpenFile()
                 attroff(COLOR_PAIR(WHITE_MAGENTA));
                 lseek(g_fdWave, nSize - sizeof(pWaveBuffer), SEEK_CUR); //ignore other parameters
             }
-            else if(0 == strncmp(pBuffer, "data ", 4))
+            else if(0 == strncmp(pBuffer, "data", 4))
             {
-                //Aligned with start of data so must have read all header
+                //Aligned with start of data so must have read all header - data is replayed from wherever it starts
                 g_offStartOfData = lseek(g_fdWave, 0, SEEK_CUR);
-                g_offEndOfData = lseek(g_fdWave, 0, SEEK_END);
-
-                if(g_offStartOfData != 44)
+                off_t offEnd = lseek(g_fdWave, 0, SEEK_END);
+                uint64_t nDataSize = (0xFFFFFFFF == nSize && g_bRf64) ? nDs64DataSize : nSize; //RF64 data size is in ds64 chunk
+                //Size may be 0 or too large if file was not finished, e.g. by a streaming recorder, so then data runs to end of file
+                bool bRelocate = nDataSize && g_offStartOfData + (off_t)nDataSize < offEnd;
+                if(bRelocate && !RelocateData(g_offStartOfData, nDataSize, offEnd))
                 {
-                    mvprintw(18, 0, "Importing file - please wait...");
-                    attron(COLOR_PAIR(COLOR_RED));
-                    mvprintw(19, 0, "                                    ");
-                    attroff(COLOR_PAIR(COLOR_RED));
-                    refresh();
-                    //Use minimal RIFF header - write new header, move wave data then truncate file
-                    off_t nWaveSize = g_offEndOfData - g_offStartOfData;
-                    WriteHeader(nWaveSize);
-                    char pData[512];
-                    off_t offRead = g_offStartOfData;
-                    off_t offWrite = 44;
-                    int nRead;
-                    int nProgress = 0;
-                    while((nRead = pread(g_fdWave, pData, sizeof(pData), offRead)) > 0)
-                    {
-                        pwrite(g_fdWave, pData, nRead, offWrite);
-                        offWrite += nRead;
-                        offRead += nRead;
-                        int nProgressTemp = 100 * offRead / nWaveSize;
-                        if(nProgressTemp != nProgress)
-                        {
-                            nProgress = nProgressTemp;
-                            mvprintw(18, 32, "% 2d%%", nProgress);
-                            attron(COLOR_PAIR(COLOR_GREEN));
-                            mvprintw(19, nProgress / 2.77, " ");
-                            attroff(COLOR_PAIR(COLOR_GREEN));
-                            refresh();
-                        }
-                    }
-                    ftruncate(g_fdWave, 44 + nWaveSize);
-                    g_offStartOfData = 44;
-                    move(18, 0);
-                    clrtoeol();
-                    move(19, 0);
-                    clrtoeol();
-                    refresh();
+                    cerr << "Unable to move audio data to end of file" << endl;
+                    CloseReplay();
+                    return false;
                 }
-
                 g_offEndOfData = lseek(g_fdWave, 0, SEEK_END);
+                g_offAllocated = g_offEndOfData;
                 g_nLastFrame = (g_offEndOfData - g_offStartOfData) / (g_nFrameSize);
+                if(bRelocate)
+                    UpdateHeader();
                 return true;
             }
             else
-                lseek(g_fdWave, nSize, SEEK_CUR); //Not found desired chunk so seek to next chunk
+                lseek(g_fdWave, nSize + (nSize & 1), SEEK_CUR); //Not found desired chunk so seek to next chunk (chunks are word aligned)
         }
         cerr << "Failed to get WAVE header";
     }
     return false;
 }
 
-//Write header
-void WriteHeader(unsigned int nWaveSize)
+bool RelocateData(off_t offData, off_t nSize, off_t offEnd)
+{
+    //Recording extends data chunk so it must be last - only needed when other chunks (e.g. LIST) follow it
+    ShowProgress("Importing file", 0);
+    off_t offNew = offEnd + (offEnd & 1) + 8; //After last chunk and new data chunk header
+    char pHeader[8];
+    memcpy(pHeader, "data", 4);
+    SetLE32(pHeader + 4, min(nSize, (off_t)0xFFFFFFFF)); //Set by UpdateHeader() once data is moved
+    if(pwrite(g_fdWave, pHeader, 8, offNew - 8) != 8)
+        return false;
+    off_t offRead = offData;
+    off_t offWrite = offNew;
+    unsigned char* pData = NULL; //Buffer for copying where kernel cannot copy within file
+    int nProgress = 0;
+    while(offRead < offData + nSize)
+    {
+        size_t nCount = min((off_t)RELOCATE_CHUNK, offData + nSize - offRead);
+        ssize_t nCopied = -1;
+        if(!pData)
+            nCopied = copy_file_range(g_fdWave, &offRead, g_fdWave, &offWrite, nCount, 0); //Copies within storage where supported, else within kernel
+        if(nCopied < 0 && (pData || ENOSYS == errno || EXDEV == errno || EINVAL == errno || EOPNOTSUPP == errno))
+        {
+            if(!pData)
+                pData = new unsigned char[WRITE_CHUNK];
+            nCopied = pread(g_fdWave, pData, min(nCount, (size_t)WRITE_CHUNK), offRead);
+            if(nCopied > 0 && pwrite(g_fdWave, pData, nCopied, offWrite) != nCopied)
+                nCopied = -1;
+            if(nCopied > 0)
+            {
+                offRead += nCopied;
+                offWrite += nCopied;
+            }
+        }
+        if(nCopied <= 0)
+        {
+            delete[] pData;
+            ftruncate(g_fdWave, offEnd); //Leave file as it was
+            return false;
+        }
+        int nProgressTemp = 100 * (offRead - offData) / nSize;
+        if(nProgressTemp != nProgress)
+        {
+            nProgress = nProgressTemp;
+            ShowProgress("Importing file", nProgress);
+        }
+    }
+    delete[] pData;
+    //Old data becomes a padding chunk that readers skip, releasing its space where filesystem supports holes
+    pwrite(g_fdWave, "JUNK", 4, offData - 8);
+    fallocate(g_fdWave, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offData, nSize);
+    g_offStartOfData = offNew;
+    ShowProgress(NULL, -1);
+    return true;
+}
+
+void ShowProgress(const char* sTask, int nPercent)
+{
+    //User interface waits for long file operations so show that it is busy and how far it has got
+    if(nPercent < 0)
+    {
+        move(18, 0);
+        clrtoeol();
+        move(19, 0);
+        clrtoeol();
+        refresh();
+        return;
+    }
+    mvprintw(18, 0, "%s - please wait... % 2d%%", sTask, nPercent);
+    attron(COLOR_PAIR(COLOR_RED));
+    mvprintw(19, 0, "                                    ");
+    attroff(COLOR_PAIR(COLOR_RED));
+    attron(COLOR_PAIR(COLOR_GREEN));
+    mvprintw(19, 0, "%*s", (int)(nPercent / 2.77), "");
+    attroff(COLOR_PAIR(COLOR_GREEN));
+    refresh();
+}
+
+//Write header
+void WriteHeader(int fd, int nChannels, unsigned int nWaveSize)
+{
+    if(fd <= 0)
+        return;
+    //Minimal RIFF header with JUNK chunk that becomes ds64 chunk if file grows beyond 4GB
+    char pHeader[WAVE_HEADER_SIZE];
+    memset(pHeader, 0, sizeof(pHeader));
+    memcpy(pHeader, "RIFF", 4);
+    SetLE32(pHeader + 4, nWaveSize + WAVE_HEADER_SIZE - 8); //size of RIFF chunck
+    memcpy(pHeader + 8, "WAVE", 4);
+    memcpy(pHeader + 12, "JUNK", 4); //space for ds64 chunk
+    SetLE32(pHeader + 16, DS64_SIZE);
+    memcpy(pHeader + 48, "fmt ", 4); //start of format chunk
+    SetLE32(pHeader + 52, 16); //size of format chunck
+    SetLE16(pHeader + 56, 1); //Audio format = PCM
+    SetLE16(pHeader + 58, nChannels); //Number of channesl
+    SetLE32(pHeader + 60, g_nSamplerate);
+    SetLE32(pHeader + 64, g_nSamplerate * nChannels * SAMPLESIZE); //Sample rate
+    SetLE16(pHeader + 68, nChannels * SAMPLESIZE); //Block align == frame size
+    SetLE16(pHeader + 70, SAMPLESIZE * 8); //Bits per sample
+    memcpy(pHeader + 72, "data", 4);
+    SetLE32(pHeader + 76, nWaveSize);
+    pwrite(fd, pHeader, sizeof(pHeader), 0);
+}
+
+void UpdateHeader()
+{
+    //Sizes that do not fit 32-bit are 0xFFFFFFFF with 64-bit sizes in ds64 chunk (RF64) - once RF64, file stays RF64
+    uint64_t nRiffSize = g_offEndOfData - 8;
+    uint64_t nDataSize = g_offEndOfData - g_offStartOfData;
+    bool bRf64 = g_offDs64 && (g_bRf64 || nRiffSize > 0xFFFFFFFF);
+    char pBuffer[8 + DS64_SIZE];
+    if(bRf64)
+    {
+        //Write ds64 chunk before changing RIFF id so that file is always valid
+        memset(pBuffer, 0, sizeof(pBuffer));
+        memcpy(pBuffer, "ds64", 4);
+        SetLE32(pBuffer + 4, g_nDs64Size); //Keeps size of reserved chunk so that following chunks do not move
+        SetLE64(pBuffer + 8, nRiffSize);
+        SetLE64(pBuffer + 16, nDataSize);
+        SetLE64(pBuffer + 24, nDataSize / g_nFrameSize); //Sample count
+        pwrite(g_fdWave, pBuffer, sizeof(pBuffer), g_offDs64); //Table length (0) is last word
+        g_bRf64 = true;
+    }
+    //Files without space for ds64 chunk show maximum sizes beyond 4GB, which most readers take to mean data runs to end of file
+    memcpy(pBuffer, bRf64 ? "RF64" : "RIFF", 4);
+    SetLE32(pBuffer + 4, bRf64 ? 0xFFFFFFFF : min(nRiffSize, (uint64_t)0xFFFFFFFF));
+    pwrite(g_fdWave, pBuffer, 8, 0);
+    SetLE32(pBuffer, bRf64 ? 0xFFFFFFFF : min(nDataSize, (uint64_t)0xFFFFFFFF));
+    pwrite(g_fdWave, pBuffer, 4, g_offStartOfData - 4);
+}
+
+//Closes WAVE file
+void CloseFile()
+{
+    UnmapFile();
+    TrimFile();
+    if(g_fdWave > 0)
+    {
+        UpdateHeader(); //Only header fields that recording changes
+        close(g_fdWave);
+    }
+    g_fdWave = -1;
+    CloseTracks();
+    g_nTransport = TC_STOP;
+    g_nChannels = 0;
+}
+
+bool IsProjectOpen()
+{
+    return g_fdWave >= 0 || g_afdTrack[0] >= 0;
+}
+
+string GetTrackFilename(const string& sProject, int nTrack)
+{
+    char pSuffix[24]; //Room for any int so that format cannot truncate
+    snprintf(pSuffix, sizeof(pSuffix), "-%02d.wav", nTrack + 1);
+    return g_sPath + sProject + pSuffix;
+}
+
+bool OpenTracks()
+{
+    //Track files are written by this application so have an 80 byte header and 16-bit mono format
+    if(0 != access(GetTrackFilename(g_sProject, 0).c_str(), F_OK))
+    {
+        //No track files so split interleaved WAVE file or start with 4 seconds of silence on each track
+        if(0 == access((g_sPath + g_sProject + ".wav").c_str(), F_OK))
+        {
+            if(!ImportTracks())
+                return false;
+        }
+        else
+        {
+            g_nSamplerate = SAMPLERATE;
+            size_t nWaveSize = g_nSamplerate * SAMPLESIZE * 4;
+            for(int nTrack = 0; nTrack < MAX_TRACKS; ++nTrack)
+            {
+                int fd = open(GetTrackFilename(g_sProject, nTrack).c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+                if(fd < 0)
+                {
+                    cerr << "Unable to create file " << GetTrackFilename(g_sProject, nTrack) << " - error " << errno << endl;
+                    return false;
+                }
+                WriteHeader(fd, 1, nWaveSize);
+                ftruncate(fd, WAVE_HEADER_SIZE + nWaveSize);
+                close(fd);
+            }
+        }
+    }
+    int64_t lFrames = 0;
+    g_nChannels = 0;
+    for(int nTrack = 0; nTrack < MAX_CHANNELS; ++nTrack)
+    {
+        string sFilename = GetTrackFilename(g_sProject, nTrack);
+        int fd = open(sFilename.c_str(), O_RDWR);
+        if(fd < 0)
+            break; //Tracks are numbered consecutively
+        char pHeader[WAVE_HEADER_SIZE];
+        if(pread(fd, pHeader, sizeof(pHeader), 0) != (ssize_t)sizeof(pHeader) || 0 != strncmp(pHeader, "RIFF", 4) || 0 != strncmp(pHeader + 8, "WAVE", 4)
+            || 0 != strncmp(pHeader + 48, "fmt ", 4) || 0 != strncmp(pHeader + 72, "data", 4) || 1 != GetLE16(pHeader + 58) || SAMPLESIZE * 8 != GetLE16(pHeader + 70)
+            || (nTrack && (int)GetLE32(pHeader + 60) != g_nSamplerate))
+        {
+            cerr << "Not a 16-bit mono track file at project's sample rate " << sFilename << endl;
+            close(fd);
+            CloseTracks();
+            return false;
+        }
+        if(0 == nTrack)
+            g_nSamplerate = GetLE32(pHeader + 60);
+        g_afdTrack[nTrack] = fd;
+        g_aoffTrackEnd[nTrack] = lseek(fd, 0, SEEK_END);
+        g_aoffTrackAllocated[nTrack] = g_aoffTrackEnd[nTrack];
+        lFrames = max(lFrames, (int64_t)(g_aoffTrackEnd[nTrack] - WAVE_HEADER_SIZE) / SAMPLESIZE); //Shorter tracks are silent to end of longest
+        ++g_nChannels;
+    }
+    if(0 == g_nChannels)
+    {
+        cerr << "Unable to open track files" << endl;
+        return false;
+    }
+    //Engine works in interleaved frames so positions map to offsets in frames as if tracks were one file without a header
+    g_nFrameSize = g_nChannels * SAMPLESIZE;
+    g_offStartOfData = 0;
+    g_offEndOfData = lFrames * g_nFrameSize;
+    g_nLastFrame = lFrames;
+    g_nPlanarMask = (g_nChannels < 64) ? ((uint64_t)1 << g_nChannels) - 1 : ~(uint64_t)0; //Read all tracks until mixer is updated
+    attron(COLOR_PAIR(WHITE_MAGENTA));
+    mvprintw(0, 27, " % 2d-bit % 6dHz ", SAMPLESIZE * 8, g_nSamplerate);
+    attroff(COLOR_PAIR(WHITE_MAGENTA));
+    return true;
+}
+
+void CloseTracks()
+{
+    for(int nTrack = 0; nTrack < MAX_CHANNELS; ++nTrack)
+    {
+        if(g_afdTrack[nTrack] < 0)
+            continue;
+        TrimFile(g_afdTrack[nTrack], g_aoffTrackEnd[nTrack], g_aoffTrackAllocated[nTrack]);
+        UpdateTrackHeader(g_afdTrack[nTrack], g_aoffTrackEnd[nTrack]);
+        close(g_afdTrack[nTrack]);
+        g_afdTrack[nTrack] = -1;
+    }
+}
+
+void UpdateTrackHeader(int fd, off_t offEnd)
+{
+    //A mono track reaches 4GB after 13 hours so track files stay RIFF, showing maximum sizes beyond that
+    char pBuffer[4];
+    SetLE32(pBuffer, min((uint64_t)offEnd - 8, (uint64_t)0xFFFFFFFF));
+    pwrite(fd, pBuffer, 4, 4);
+    SetLE32(pBuffer, min((uint64_t)offEnd - WAVE_HEADER_SIZE, (uint64_t)0xFFFFFFFF));
+    pwrite(fd, pBuffer, 4, WAVE_HEADER_SIZE - 4);
+}
+
+bool ImportTracks()
+{
+    //Each chunk of frames is read once and each track's column is gathered and written to its file
+    CloseFile();
+    if(0 != access((g_sPath + g_sProject + ".wav").c_str(), F_OK) || !OpenFile())
+        return false;
+    int nTracks = g_nChannels;
+    int pFd[MAX_CHANNELS];
+    for(int nTrack = 0; nTrack < nTracks; ++nTrack)
+    {
+        //Open every track file before truncating any so that existing tracks survive a failure
+        pFd[nTrack] = open(GetTrackFilename(g_sProject, nTrack).c_str(), O_RDWR | O_CREAT, 0644);
+        if(pFd[nTrack] < 0)
+        {
+            cerr << "Unable to open or create file " << GetTrackFilename(g_sProject, nTrack) << " - error " << errno << endl;
+            while(nTrack--)
+                close(pFd[nTrack]);
+            CloseFile();
+            return false;
+        }
+    }
+    for(int nTrack = 0; nTrack < nTracks; ++nTrack)
+    {
+        ftruncate(pFd[nTrack], 0);
+        WriteHeader(pFd[nTrack], 1, 0);
+    }
+    for(int nTrack = nTracks; nTrack < MAX_CHANNELS; ++nTrack)
+        unlink(GetTrackFilename(g_sProject, nTrack).c_str()); //Remove tracks left from a project with more tracks
+    int nChunk = max(1, WRITE_CHUNK / g_nFrameSize); //Frames in each read
+    unsigned char* pFrames = new unsigned char[nChunk * g_nFrameSize];
+    unsigned char* pSamples = new unsigned char[nChunk * SAMPLESIZE];
+    int64_t lFrames = (g_offEndOfData - g_offStartOfData) / g_nFrameSize;
+    bool bResult = true;
+    int nProgress = 0;
+    ShowProgress("Importing tracks", 0);
+    for(int64_t lFrame = 0; lFrame < lFrames && bResult; lFrame += nChunk)
+    {
+        int nFrames = min((int64_t)nChunk, lFrames - lFrame);
+        bResult = pread(g_fdWave, pFrames, nFrames * g_nFrameSize, g_offStartOfData + lFrame * g_nFrameSize) == nFrames * g_nFrameSize;
+        for(int nTrack = 0; nTrack < nTracks && bResult; ++nTrack)
+        {
+            GatherTrack(pSamples, pFrames, nTrack, nFrames);
+            bResult = pwrite(pFd[nTrack], pSamples, nFrames * SAMPLESIZE, WAVE_HEADER_SIZE + lFrame * SAMPLESIZE) == nFrames * SAMPLESIZE;
+        }
+        int nProgressTemp = 100 * (lFrame + nFrames) / lFrames;
+        if(nProgressTemp != nProgress)
+        {
+            nProgress = nProgressTemp;
+            ShowProgress("Importing tracks", nProgress);
+        }
+    }
+    for(int nTrack = 0; nTrack < nTracks; ++nTrack)
+    {
+        UpdateTrackHeader(pFd[nTrack], WAVE_HEADER_SIZE + lFrames * SAMPLESIZE);
+        close(pFd[nTrack]);
+    }
+    delete[] pSamples;
+    delete[] pFrames;
+    ShowProgress(NULL, -1);
+    CloseFile();
+    if(!bResult)
+        cerr << "Failed to import tracks" << endl;
+    return bResult;
+}
+
+bool ExportTracks()
+{
+    //Interleaved file is written afresh with room for RF64 sizes, like a new project's file
+    g_fdWave = open((g_sPath + g_sProject + ".wav").c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(g_fdWave < 0)
+        return false;
+    WriteHeader(g_fdWave, g_nChannels, 0);
+    off_t offEndOfTracks = g_offEndOfData;
+    g_offStartOfData = WAVE_HEADER_SIZE;
+    g_offDs64 = 12;
+    g_nDs64Size = DS64_SIZE;
+    g_bRf64 = false;
+    int nChunk = max(1, WRITE_CHUNK / g_nFrameSize); //Frames in each write
+    unsigned char* pFrames = new unsigned char[nChunk * g_nFrameSize];
+    unsigned char* pSamples = new unsigned char[nChunk * SAMPLESIZE];
+    int64_t lFrames = offEndOfTracks / g_nFrameSize;
+    bool bResult = true;
+    int nProgress = 0;
+    ShowProgress("Exporting tracks", 0);
+    for(int64_t lFrame = 0; lFrame < lFrames && bResult; lFrame += nChunk)
+    {
+        int nFrames = min((int64_t)nChunk, lFrames - lFrame);
+        memset(pFrames, 0, nFrames * g_nFrameSize);
+        for(int nTrack = 0; nTrack < g_nChannels; ++nTrack)
+        {
+            ssize_t nRead = pread(g_afdTrack[nTrack], pSamples, nFrames * SAMPLESIZE, WAVE_HEADER_SIZE + lFrame * SAMPLESIZE);
+            if(nRead > 0)
+                SpreadTrack(pFrames, pSamples, nTrack, nRead / SAMPLESIZE); //Shorter tracks are silent
+        }
+        bResult = pwrite(g_fdWave, pFrames, nFrames * g_nFrameSize, g_offStartOfData + lFrame * g_nFrameSize) == nFrames * g_nFrameSize;
+        int nProgressTemp = 100 * (lFrame + nFrames) / lFrames;
+        if(nProgressTemp != nProgress)
+        {
+            nProgress = nProgressTemp;
+            ShowProgress("Exporting tracks", nProgress);
+        }
+    }
+    delete[] pSamples;
+    delete[] pFrames;
+    g_offEndOfData = g_offStartOfData + lFrames * g_nFrameSize;
+    UpdateHeader();
+    close(g_fdWave);
+    g_fdWave = -1;
+    ShowProgress(NULL, -1);
+    if(!bResult)
+        cerr << "Failed to export tracks" << endl;
+    return bResult;
+}
+
+void GatherTrack(unsigned char* pSamples, const unsigned char* pFrames, int nTrack, int nFrames)
+{
+    //Samples are copied as little-endian bytes, as they are stored, so that byte order of host does not matter
+    const unsigned char* pColumn = pFrames + nTrack * SAMPLESIZE;
+    for(int i = 0; i < nFrames; ++i)
+    {
+        pSamples[i * SAMPLESIZE] = pColumn[i * g_nFrameSize];
+        pSamples[i * SAMPLESIZE + 1] = pColumn[i * g_nFrameSize + 1];
+    }
+}
+
+void SpreadTrack(unsigned char* pFrames, const unsigned char* pSamples, int nTrack, int nFrames)
+{
+    unsigned char* pColumn = pFrames + nTrack * SAMPLESIZE;
+    for(int i = 0; i < nFrames; ++i)
+    {
+        pColumn[i * g_nFrameSize] = pSamples[i * SAMPLESIZE];
+        pColumn[i * g_nFrameSize + 1] = pSamples[i * SAMPLESIZE + 1];
+    }
+}
+
+ssize_t ReadTracks(unsigned char* pFrames, int nFrames, int64_t lFrom)
+{
+    //Returns size of frames read, less than requested at end of longest track - each track's samples are spread to its column of frames
+    nFrames = max((int64_t)0, min((int64_t)nFrames, g_offEndOfData.load() / g_nFrameSize - lFrom));
+    memset(pFrames, 0, nFrames * g_nFrameSize);
+    uint64_t nMask = g_nPlanarMask.load(memory_order_relaxed);
+    for(int nTrack = 0; nTrack < g_nChannels; ++nTrack)
+    {
+        if(0 == (nMask & ((uint64_t)1 << nTrack)))
+            continue; //Not heard so left silent
+        ssize_t nRead = pread(g_afdTrack[nTrack], g_pPlanarRead, nFrames * SAMPLESIZE, WAVE_HEADER_SIZE + (off_t)lFrom * SAMPLESIZE);
+        if(nRead < 0)
+            return -1;
+        SpreadTrack(pFrames, g_pPlanarRead, nTrack, nRead / SAMPLESIZE); //Shorter tracks are silent beyond their end
+    }
+    return nFrames * g_nFrameSize;
+}
+
+bool WriteTracks(const unsigned char* pFrames, size_t nBytes, int64_t nTag)
+{
+    //Only armed tracks' columns hold recorded audio - others are replayed frames already in their files
+    int64_t lPos = nTag & TAG_POS_MASK;
+    int nFrames = nBytes / g_nFrameSize;
+    int nRecA = ((nTag >> TAG_POS_BITS) & 0xFF) - 1;
+    int nRecB = ((nTag >> (TAG_POS_BITS + 8)) & 0xFF) - 1;
+    bool bResult = true;
+    for(int nLeg = 0; nLeg < 2; ++nLeg)
+    {
+        int nTrack = nLeg ? nRecB : nRecA;
+        if(nTrack < 0 || nTrack >= g_nChannels || (nLeg && nTrack == nRecA))
+            continue;
+        GatherTrack(g_pPlanarWrite, pFrames, nTrack, nFrames);
+        off_t offWrite = WAVE_HEADER_SIZE + (off_t)lPos * SAMPLESIZE;
+        off_t offNeeded = offWrite + nFrames * SAMPLESIZE;
+        if(offNeeded > g_aoffTrackAllocated[nTrack])
+        {
+            UpdateTrackHeader(g_afdTrack[nTrack], g_aoffTrackEnd[nTrack]); //Keep header up to date with each extent so that file is readable if not closed cleanly
+            ExtendFile(g_afdTrack[nTrack], g_aoffTrackEnd[nTrack], offNeeded, g_aoffTrackAllocated[nTrack]);
+        }
+        if(pwrite(g_afdTrack[nTrack], g_pPlanarWrite, nFrames * SAMPLESIZE, offWrite) != nFrames * SAMPLESIZE)
+            bResult = false;
+        else if(offNeeded > g_aoffTrackEnd[nTrack])
+            g_aoffTrackEnd[nTrack] = offNeeded;
+    }
+    return bResult;
+}
+
+void RunStorageTask()
+{
+    //Engine threads depend on project's files and quantity of tracks so are stopped whilst files are rewritten
+    StopEngine();
+    SaveProject();
+    bool bExport = (STORAGE_EXPORT == g_nStorageTask);
+    bool bResult = bExport ? ExportTracks() : ImportTracks();
+    g_nStorageTask = 0;
+    LoadProject(g_sProject); //Import may change quantity of tracks
+    PublishMixer();
+    StartEngine();
+    if(!bResult)
+        mvprintw(18, 0, "Failed to %s tracks", bExport ? "export" : "import");
+}
+
+void SetPlayHead(int64_t nPosition)
+{
+    g_lHeadPos = nPosition;
+    if(g_lHeadPos < 0)
+        g_lHeadPos = 0;
+    if(g_lHeadPos > g_nLastFrame)
+        g_lHeadPos = g_nLastFrame.load();
+    PrefetchSeek(g_lHeadPos);
+    ResetRecordPosition();
+}
+
+//Open replay device
+bool OpenReplay()
+{
+    int nError;
+    if(g_pPcmPlay)
+        return true;
+
+    //**Open sound device**
+    if((nError = snd_pcm_open(&g_pPcmPlay, g_sPcmPlayName.c_str(), SND_PCM_STREAM_PLAYBACK, 0)) != 0)
+    {
+        cerr << "Unable to open replay device: " << snd_strerror(nError) << endl;
+        CloseReplay();
+        return false;
+    }
+    if((nError = snd_pcm_set_params(g_pPcmPlay,
+                                  SND_PCM_FORMAT_S16_LE, //!@todo does this depend on WAVE file format?
+                                  SND_PCM_ACCESS_RW_INTERLEAVED,
+                                  2, //2 channels (left & right)
+                                  g_nSamplerate,
+                                  0, //Don't resample
+                                  g_bMonitor ? MONITOR_PERIODS * g_nPeriodTime : REPLAY_LATENCY)) != 0) //Monitored input must not queue behind much replay
+    {
+        cerr << "Unable to configure replay device: " << snd_strerror(nError) << endl;
+        CloseReplay();
+        return false;
+    }
+    DeferStart(g_pPcmPlay);
+
+	return true;
+}
+
+//Close replay device
+void CloseReplay()
+{
+    if(g_pPcmPlay && g_bLinked)
+        snd_pcm_unlink(g_pPcmPlay);
+    g_bLinked = false;
+    if(g_pPcmPlay)
+        snd_pcm_close(g_pPcmPlay);
+    g_pPcmPlay = NULL;
+    if(!g_bRecordEnabled)
+        g_nTransport = TC_STOP;
+}
+
+//Open record device
+bool OpenRecord()
+{
+    if(g_pPcmRecord)
+        return true; //Already open
+
+    //**Open sound device**
+    int nError;
+    if((nError = snd_pcm_open(&g_pPcmRecord, g_sPcmRecName.c_str(), SND_PCM_STREAM_CAPTURE, 0)) != 0)
+    {
+        cerr << "Unable to open record device: " << snd_strerror(nError) << endl;
+        CloseRecord();
+        return false;
+    }
+    if((nError = snd_pcm_set_params(g_pPcmRecord,
+                                  SND_PCM_FORMAT_S16_LE, //!@todo does this depend on WAVE file format?
+                                  SND_PCM_ACCESS_RW_INTERLEAVED,
+                                  2, //2 channels (left & right)
+                                  g_nSamplerate,
+                                  0, //Don't resample
+                                  RECORD_LATENCY)) != 0)
+    {
+        cerr << "Unable to configure record device: " << snd_strerror(nError) << endl;
+        CloseRecord();
+        return false;
+    }
+    DeferStart(g_pPcmRecord);
+
+	return true;
+}
+
+//Close record device
+void CloseRecord()
+{
+    if(g_pPcmRecord && g_bLinked)
+        snd_pcm_unlink(g_pPcmRecord);
+    g_bLinked = false;
+    if(g_pPcmRecord)
+        snd_pcm_close(g_pPcmRecord);
+    g_pPcmRecord = NULL;
+    UpdateMixer();
+}
+
+void DeferStart(snd_pcm_t* pPcm)
+{
+    snd_pcm_sw_params_t* pParams;
+    snd_pcm_uframes_t nBoundary;
+    if(snd_pcm_sw_params_malloc(&pParams))
+        return;
+    if(0 == snd_pcm_sw_params_current(pPcm, pParams) && 0 == snd_pcm_sw_params_get_boundary(pParams, &nBoundary))
+    {
+        snd_pcm_sw_params_set_start_threshold(pPcm, pParams, nBoundary); //Only start on explicit snd_pcm_start()
+        snd_pcm_sw_params(pPcm, pParams);
+    }
+    snd_pcm_sw_params_free(pParams);
+}
+
+bool Play()
+{
+    if(!g_pPcmPlay || !IsProjectOpen() || ((TC_PLAY != g_nTransport)))
+        return false;
+
+    //Get period from read-ahead buffer
+    //!@todo handle different bits/sample size
+    int64_t nStart = GetMicroseconds();
+    memset(g_pPlayBuffer, 0, sizeof(g_pPlayBuffer)); //silence output buffer
+    const unsigned char* pReadBuffer = NULL;
+    int nRead = PrefetchRead(&pReadBuffer);
+    nStart = AddTiming(PHASE_READ, nStart);
+    int nFrames = nRead / g_nFrameSize; //Quantity of frames to advance play head
+    bool bPlaying = (nRead != 0); //If we reach end of file then we should stop
+    if(0 == nRead && g_bRecordEnabled && (-1 != g_nRecA || -1 != g_nRecB))
+    {
+        //Recording beyond end of file so keep rolling with silence
+        bPlaying = true;
+        pReadBuffer = (const unsigned char*)g_pSilence;
+        nRead = g_nPeriodSize;
+        nFrames = PERIOD_SIZE;
+    }
+    if(nRead < 0)
+        nFrames = 0; //Read-ahead not ready so play silence without moving play head
+    if(bPlaying)
+    {
+        if(g_mixer.Update())
+            UpdateMixer();
+        //Mix each frame to output buffer
+        if(nRead > 0)
+            Mixdown(pReadBuffer, nRead / g_nFrameSize);
+        else
+        {
+            if(g_nFadeDir < 0)
+                g_nFadePos = 0; //Nothing to fade whilst read-ahead catches up so finish fading out
+            MonitorInput(g_pPlayBuffer); //Performer still hears input
+        }
+        nStart = AddTiming(PHASE_MIX, nStart);
+        if(g_bRecordEnabled && nFrames)
+        {
+            //Retain replayed frames to merge with recorded audio
+            int nFrame = g_lHeadPos % g_nHistoryFrames;
+            int nCount = min(nFrames, g_nHistoryFrames - nFrame);
+            memcpy(g_pHistory + nFrame * g_nFrameSize, pReadBuffer, nCount * g_nFrameSize);
+            memcpy(g_pHistory, pReadBuffer + nCount * g_nFrameSize, (nFrames - nCount) * g_nFrameSize);
+            g_lHistoryEnd = g_lHeadPos + nFrames;
+        }
+        if(pReadBuffer != (const unsigned char*)g_pSilence && nRead > 0)
+            PrefetchRelease(nFrames);
+        PrefetchReread();
+        if(g_nStartRequested && nFrames)
+        {
+            //First audio since start request is heard after the frames already queued
+            snd_pcm_sframes_t nDelay = 0;
+            snd_pcm_delay(g_pPcmPlay, &nDelay);
+            g_nStartLatency = GetMicroseconds() - g_nStartRequested + (int64_t)nDelay * 1000000 / g_nSamplerate;
+            g_nStartRequested = 0;
+        }
+        g_lHeadPos += nFrames;
+        snd_pcm_sframes_t nBlocks;
+        //Send output buffer to soundcard replay output
+        nBlocks = snd_pcm_writei(g_pPcmPlay, g_pPlayBuffer, PERIOD_SIZE);
+        switch(nBlocks)
+        {
+            case -EPIPE:
+                //Broken Pipe == Underrun
+                ++g_nUnderruns;
+                RestartDuplex();
+                break;
+            case -EBADFD:
+            case -ESTRPIPE:
+                g_nReplayError = nBlocks;
+                snd_pcm_recover(g_pPcmPlay, nBlocks, 1); //Attempt to recover from error
+                RestartDuplex();
+                break;
+        }
+        AddTiming(PHASE_REPLAY, nStart);
+    }
+    //Return true if more to play else false if at end of file or faded out after stop. Don't fail if we are in record mode
+    return bPlaying && !(g_nFadeDir < 0 && 0 == g_nFadePos);
+}
+
+void PrefetchWake()
+{
+    eventfd_write(g_fdPrefetchWake, 1);
+}
+
+void PrefetchSeek(int64_t lFrame)
+{
+    g_ringPrefetch.Flush(); //Discard blocks already read - disk thread discards any it reads before seeing this request
+    g_lPrefetchFrom = lFrame;
+    g_lPrefetchNext = lFrame;
+    g_lMapHead.store(lFrame, memory_order_relaxed);
+    g_nPrefetchRequest.fetch_add(1, memory_order_release);
+    PrefetchWake();
+}
+
+//Returns size in bytes of next period (pointed to by *ppData), 0 if at end of file or -1 if data not yet available
+int PrefetchRead(const unsigned char** ppData)
+{
+    unsigned int nRequest = g_nPrefetchRequest.load(memory_order_relaxed);
+    if(g_nPrefetchAck.load(memory_order_acquire) != nRequest)
+        return -1; //Disk thread has not yet seen last seek
+    if(g_nPrefetchFlushed != nRequest)
+    {
+        //Discard blocks read before disk thread saw last seek
+        g_ringPrefetch.Flush(g_nPrefetchFlush);
+        g_nPrefetchFlushed = nRequest;
+    }
+    unsigned char* pMap = g_pMapData.load(memory_order_acquire);
+    if(pMap)
+    {
+        //Replay straight from mapping - disk thread has made it resident up to g_lMapReady
+        g_pMapSeen.store(pMap, memory_order_release);
+        bool bEnd = (g_nPrefetchEnd.load(memory_order_acquire) == nRequest); //Before g_lMapReady so that it is final at end of file
+        int64_t lFrames = min((int64_t)PERIOD_SIZE, g_lMapReady.load(memory_order_acquire) - g_lPrefetchNext);
+        *ppData = pMap + (off_t)g_lPrefetchNext * g_nFrameSize;
+        if(PERIOD_SIZE == lFrames || (bEnd && lFrames > 0))
+            return lFrames * g_nFrameSize;
+        *ppData = NULL;
+        if(bEnd)
+            return 0; //End of file
+        ++g_nDiskUnderruns;
+        return -1;
+    }
+    int nSize;
+    *ppData = g_ringPrefetch.GetReadPointer(&nSize);
+    if(*ppData)
+        return nSize;
+    if(g_nPrefetchEnd.load(memory_order_acquire) == nRequest)
+        return 0; //End of file
+    ++g_nDiskUnderruns;
+    return -1;
+}
+
+void PrefetchRelease(int nFrames)
+{
+    g_lPrefetchNext += nFrames;
+    if(g_pMapData.load(memory_order_relaxed))
+    {
+        //Tell disk thread how far play head has reached, waking it each disk read
+        g_lMapHead.store(g_lPrefetchNext, memory_order_relaxed);
+        if(g_lPrefetchNext % (g_nPrefetchChunk * PERIOD_SIZE) < nFrames)
+            PrefetchWake();
+    }
+    else if(g_ringPrefetch.Release() == g_nPrefetchChunk)
+        PrefetchWake(); //Space for another disk read
+}
+
+void PrefetchReread()
+{
+    //Blocks already read ahead are silent on tracks that were not read
+    if(!g_bPrefetchReread)
+        return;
+    g_bPrefetchReread = false;
+    if(g_lPrefetchNext >= 0)
+        PrefetchSeek(g_lPrefetchNext);
+}
+
+void Prefetch()
+{
+    if(g_bRealtime)
+        StartRealtime(false);
+    unsigned int nRequest = g_nPrefetchAck;
+    off_t offRead = g_offStartOfData;
+    int64_t lReady = 0; //Frame up to which mapped data is resident
+    int64_t lDropped = 0; //Frame below which mapped data has been released
+    bool bEnd = true;
+    while(g_bPrefetchRunning)
+    {
+        unsigned int nNewRequest = g_nPrefetchRequest.load(memory_order_acquire);
+        if(nNewRequest != nRequest)
+        {
+            //Audio thread has moved play head so read from new position after recorded audio reaches disk
+            WriterWait();
+            nRequest = nNewRequest;
+            offRead = g_offStartOfData + g_lPrefetchFrom * g_nFrameSize;
+            lReady = g_lPrefetchFrom;
+            lDropped = lReady;
+            g_lMapReady.store(lReady, memory_order_relaxed);
+            bEnd = false;
+            g_nPrefetchFlush = g_ringPrefetch.GetWriteIndex();
+            g_nPrefetchAck.store(nRequest, memory_order_release);
+        }
+        if(g_pMapData.load(memory_order_relaxed) && PrefetchMap(nRequest, lReady, lDropped, bEnd))
+            continue;
+        int nBlocks = g_ringPrefetch.GetWriteSpace(true);
+        if(nBlocks > g_nPrefetchChunk)
+            nBlocks = g_nPrefetchChunk;
+        if(bEnd || g_pMapData.load(memory_order_relaxed) || g_ringPrefetch.GetWriteSpace() < g_nPrefetchChunk)
+        {
+            //Nothing to do until audio thread consumes data or seeks
+            pollfd pfd = {g_fdPrefetchWake, POLLIN, 0};
+            eventfd_t nValue;
+            if(poll(&pfd, 1, PREFETCH_TIMEOUT) > 0)
+                eventfd_read(g_fdPrefetchWake, &nValue);
+            continue;
+        }
+        //Read large chunk directly in to ring
+        ssize_t nRead;
+        if(g_bPlanar)
+            nRead = ReadTracks(g_ringPrefetch.GetWritePointer(), nBlocks * PERIOD_SIZE, (offRead - g_offStartOfData) / g_nFrameSize);
+        else
+            nRead = pread(g_fdWave, g_ringPrefetch.GetWritePointer(), min((off_t)nBlocks * g_nPeriodSize, max((off_t)0, g_offEndOfData.load() - offRead)), offRead); //File may extend beyond end of data whilst space is allocated ahead of recording
+        if(nRead < 0)
+        {
+            if(EINTR != errno)
+                bEnd = true;
+            continue;
+        }
+        nRead -= nRead % g_nFrameSize; //Ignore partial frame at end of file
+        offRead += nRead;
+        int nFull = nRead / g_nPeriodSize;
+        for(int nBlock = 0; nBlock < nFull; ++nBlock)
+            g_ringPrefetch.SetSize(nBlock, g_nPeriodSize);
+        if(nRead < nBlocks * g_nPeriodSize)
+        {
+            //Reached end of file
+            int nPartial = nRead - nFull * g_nPeriodSize;
+            if(nPartial)
+            {
+                g_ringPrefetch.SetSize(nFull, nPartial);
+                ++nFull;
+            }
+            bEnd = true;
+        }
+        g_ringPrefetch.CommitWrite(nFull);
+        if(bEnd)
+            g_nPrefetchEnd.store(nRequest, memory_order_release);
+    }
+}
+
+bool PrefetchMap(unsigned int nRequest, int64_t& lReady, int64_t& lDropped, bool& bEnd)
+{
+    //Returns true if there may be more to do now, false to wait for audio thread to consume data or seek
+    if(g_pMapOld && g_pMapSeen.load(memory_order_acquire) == g_pMapData.load(memory_order_relaxed))
+    {
+        //Audio thread has moved to current mapping
+        munmap(g_pMapOld, g_nMapOldSize);
+        g_pMapOld = NULL;
+    }
+    unsigned char* pMap = g_pMapData.load(memory_order_relaxed);
+    long nPage = sysconf(_SC_PAGESIZE);
+    int64_t lHead = g_lMapHead.load(memory_order_relaxed);
+    int64_t lChunk = (int64_t)g_nPrefetchChunk * PERIOD_SIZE; //Frames in each disk read
+    if(lHead - lDropped >= lChunk)
+    {
+        //Release replayed pages (unlock first in case real-time mode locked them as they were touched)
+        uintptr_t nFrom = ((uintptr_t)(pMap + (off_t)lDropped * g_nFrameSize) + nPage - 1) & ~(uintptr_t)(nPage - 1);
+        uintptr_t nTo = (uintptr_t)(pMap + (off_t)lHead * g_nFrameSize) & ~(uintptr_t)(nPage - 1);
+        if(nTo > nFrom)
+        {
+            munlock((void*)nFrom, nTo - nFrom);
+            madvise((void*)nFrom, nTo - nFrom, MADV_DONTNEED);
+        }
+        lDropped = lHead;
+    }
+    if(bEnd)
+        return false;
+    int64_t lEnd = (g_offEndOfData.load() - g_offStartOfData) / g_nFrameSize;
+    int64_t lTarget = min(lEnd, lHead + (int64_t)(g_fPrefetchSeconds * g_nSamplerate));
+    if(lReady >= lEnd)
+    {
+        //Whole file is resident ahead of play head
+        bEnd = true;
+        g_nPrefetchEnd.store(nRequest, memory_order_release);
+        return false;
+    }
+    if(lTarget - lReady < lChunk && lTarget < lEnd)
+        return false; //Wait until a whole disk read is needed
+    lTarget = min(lTarget, lReady + lChunk); //One disk read at a time so that seeks are seen promptly
+    off_t offTarget = g_offStartOfData + (off_t)lTarget * g_nFrameSize;
+    if(offTarget > g_offMap + (off_t)g_nMapSize)
+    {
+        //File has grown beyond mapping
+        if(!RemapFile(offTarget))
+            return false;
+        pMap = g_pMapData.load(memory_order_relaxed);
+    }
+    //Ask for whole window to be read then touch each page so that audio thread never waits for a page fault
+    uintptr_t nFrom = (uintptr_t)(pMap + (off_t)lReady * g_nFrameSize) & ~(uintptr_t)(nPage - 1);
+    uintptr_t nTo = (uintptr_t)(pMap + (off_t)lTarget * g_nFrameSize);
+    madvise((void*)nFrom, nTo - nFrom, MADV_WILLNEED);
+    for(uintptr_t nAddress = nFrom; nAddress < nTo; nAddress += nPage)
+        (void)*(volatile unsigned char*)nAddress;
+    lReady = lTarget;
+    g_lMapReady.store(lReady, memory_order_release);
+    return true;
+}
+
+bool MapFile()
+{
+    UnmapFile();
+    if(g_fdWave < 0)
+        return false;
+    //Map beyond end of file so that recorded audio appended to file can be replayed without remapping
+    off_t offMap = g_offStartOfData - g_offStartOfData % sysconf(_SC_PAGESIZE); //Mapping must start on page boundary
+    uint64_t nSize = g_offEndOfData - offMap + MAP_RESERVE;
+    if(nSize > SIZE_MAX / 2)
+        return false; //Too large for address space, e.g. long project on 32-bit system
+    void* pMap = mmap(NULL, nSize, PROT_READ, MAP_SHARED, g_fdWave, offMap);
+    if(MAP_FAILED == pMap)
+        return false;
+    g_pMapBase = (unsigned char*)pMap;
+    g_nMapSize = nSize;
+    g_offMap = offMap;
+    g_pMapData = g_pMapBase + (g_offStartOfData - offMap);
+    g_pMapSeen = g_pMapData.load();
+    return true;
+}
+
+bool RemapFile(off_t offNeeded)
+{
+    if(g_pMapOld)
+        return false; //Audio thread may still be reading previous mapping
+    uint64_t nSize = offNeeded - g_offMap + MAP_RESERVE;
+    if(nSize > SIZE_MAX / 2)
+        return false;
+    void* pMap = mmap(NULL, nSize, PROT_READ, MAP_SHARED, g_fdWave, g_offMap);
+    if(MAP_FAILED == pMap)
+        return false;
+    //Keep previous mapping until audio thread has fetched a period from new one
+    g_pMapOld = g_pMapBase;
+    g_nMapOldSize = g_nMapSize;
+    g_pMapBase = (unsigned char*)pMap;
+    g_nMapSize = nSize;
+    g_pMapData.store(g_pMapBase + (g_offStartOfData - g_offMap), memory_order_release);
+    return true;
+}
+
+void UnmapFile()
+{
+    if(g_pMapOld)
+        munmap(g_pMapOld, g_nMapOldSize);
+    if(g_pMapBase)
+        munmap(g_pMapBase, g_nMapSize);
+    g_pMapOld = NULL;
+    g_pMapBase = NULL;
+    g_pMapData = NULL;
+    g_pMapSeen = NULL;
+}
+
+bool Record()
+{
+    if(TC_PLAY != g_nTransport)
+        return false; //Can't record if we are not rolling
+    if(!g_pPcmRecord)
+        return false; //Record device not open
+
+    unsigned char* pRecBuffer = g_pRecBuffer;
+    g_nMonitorFrames = 0;
+    memset(pRecBuffer, 0, sizeof(g_pRecBuffer)); //silence record buffer
+    snd_pcm_sframes_t nBlocks = snd_pcm_readi(g_pPcmRecord, pRecBuffer, PERIOD_SIZE);
+    switch(nBlocks)
+    {
+        case -EPIPE:
+            //Broken Pipe == Overrun
+            ++g_nOverruns;
+            RestartDuplex(); //Lost recorded frames so restart both devices and realign
+            return true;
+        case -EBADFD:
+        case -ESTRPIPE:
+            g_nRecordError = nBlocks;
+            snd_pcm_recover(g_pPcmRecord, nBlocks, 1); //Attempt to recover from error
+            RestartDuplex();
+            return true;
+    }
+    if(nBlocks <= 0)
+        return true;
+    if(g_bMonitor)
+        g_nMonitorFrames = nBlocks; //Mixed to output by Play() in this cycle
+
+    //Keep counting captured frames whilst not recording so that record position stays aligned with replay
+    int64_t lPos = g_lRecordPos;
+    g_lRecordPos += nBlocks;
+    int nSkip = nBlocks; //Quantity of captured frames not merged with replayed frames - all whilst not recording
+    if(g_bRecordEnabled && IsProjectOpen() && (-1 != g_nRecA || -1 != g_nRecB))
+    {
+        nSkip = 0;
+        if(lPos < g_lHistoryStart)
+            nSkip = min((int64_t)nBlocks, g_lHistoryStart - lPos); //Recorded frames before start of replayed frames (pre-roll)
+        if(lPos + nBlocks <= g_lHistoryEnd - g_nHistoryFrames)
+            nSkip = nBlocks; //Replayed frames already overwritten (record offset too large)
+        if(nSkip < nBlocks && g_ringWrite.GetWriteSpace() < 1)
+        {
+            ++g_nDiskOverruns; //Disk not keeping up
+            nSkip = nBlocks;
+        }
+    }
+    //Merged frames are metered as they are copied so only meter the rest here, each captured sample is read once
+    MeterInput(pRecBuffer, nSkip);
+    if(nSkip == nBlocks)
+        return true; //Captured audio discarded
+
+    //Merge recorded samples with replayed frames and queue for writing to disk
+    g_pMergeKernel(g_ringWrite.GetWritePointer(), pRecBuffer + nSkip * 2 * SAMPLESIZE, lPos + nSkip, nBlocks - nSkip);
+    g_ringWrite.SetSize(0, (nBlocks - nSkip) * g_nFrameSize);
+    g_ringWrite.SetTag(0, (lPos + nSkip) | ((int64_t)((g_nRecA + 1) | ((g_nRecB + 1) << 8)) << TAG_POS_BITS)); //Planar storage writes only armed tracks
+    g_ringWrite.CommitWrite(1);
+    if(g_ringWrite.GetReadSpace() == g_nWriteChunk)
+        eventfd_write(g_fdWriteWake, 1); //Enough for a disk write
+    if(lPos + nBlocks > g_nLastFrame)
+        g_nLastFrame = lPos + nBlocks; //Extending file
+    return true;
+}
+
+/** Structure accumulating one capture leg's input meter reading within a period (audio thread) **/
+struct InputLeg
+{
+    int nMax = 0; //Largest sample value
+    int nMin = 0; //Smallest sample value
+
+    /** Add a little-endian sample - just a compare each way so that metering costs little more than copying */
+    void Add(const unsigned char* pSample)
+    {
+        int16_t nSample = pSample[0] + (pSample[1] << 8); //get little endian sample into 16-bit word
+        nMax = max(nMax, (int)nSample);
+        nMin = min(nMin, (int)nSample);
+    }
+
+    /** Add reading to leg's input peak and count an overload if leg reached full scale after a period that did not */
+    void Store(int nLeg)
+    {
+        int nPeak = min(max(nMax, -nMin), (int)METER_CLIP);
+        g_pInputPeak[nLeg] = max(g_pInputPeak[nLeg], (int16_t)nPeak);
+        bool bClipping = (METER_CLIP == nPeak);
+        if(bClipping && !g_pInputClipping[nLeg])
+            ++g_aInputClips[nLeg];
+        g_pInputClipping[nLeg] = bClipping;
+    }
+};
+
+/** Record merge kernel - WIDTH channels (0 = any) - meters each captured sample as it is copied */
+template <int WIDTH> static void MergeRecord(unsigned char* pFrames, const unsigned char* pRecBuffer, int64_t lFrame, int nFrames)
+{
+    int nFrameSize = WIDTH ? WIDTH * SAMPLESIZE : g_nFrameSize; //Fixed frame size lets compiler inline copies
+    int nRecA = g_nRecA;
+    int nRecB = g_nRecB;
+    InputLeg legA;
+    InputLeg legB;
+    unsigned char* pFrame = pFrames;
+    for(int nFrame = 0; nFrame < nFrames; ++nFrame)
+    {
+        if(lFrame + nFrame < g_lHistoryEnd)
+            memcpy(pFrame, g_pHistory + ((lFrame + nFrame) % g_nHistoryFrames) * nFrameSize, nFrameSize);
+        else
+            memset(pFrame, 0, nFrameSize);
+        if(-1 != nRecA)
+            memcpy(pFrame + nRecA * SAMPLESIZE, pRecBuffer + nFrame * 4, SAMPLESIZE);
+        if(-1 != nRecB)
+            memcpy(pFrame + nRecB * SAMPLESIZE, pRecBuffer + nFrame * 4 + 2, SAMPLESIZE);
+        legA.Add(pRecBuffer + nFrame * 4);
+        legB.Add(pRecBuffer + nFrame * 4 + 2);
+        pFrame += nFrameSize;
+    }
+    legA.Store(0);
+    legB.Store(1);
+}
+
+void MeterInput(const unsigned char* pRecBuffer, int nFrames)
+{
+    if(0 == nFrames)
+        return; //All frames merged and metered by merge kernel
+    InputLeg legA;
+    InputLeg legB;
+    for(int nFrame = 0; nFrame < nFrames; ++nFrame)
+    {
+        legA.Add(pRecBuffer + nFrame * 4);
+        legB.Add(pRecBuffer + nFrame * 4 + 2);
+    }
+    legA.Store(0);
+    legB.Store(1);
+}
+
+/** Record merge kernels for any quantity of channels then each width in FRAME_WIDTH */
+static const MergeKernel g_aMergeKernels[FRAME_WIDTHS + 1] = {MergeRecord<0>, MergeRecord<2>, MergeRecord<4>, MergeRecord<8>, MergeRecord<12>, MergeRecord<16>, MergeRecord<24>, MergeRecord<32>, MergeRecord<64>};
+
+/** Get index of a quantity of channels in FRAME_WIDTH
+*   @param  nChannels Quantity of channels
+*   @return <i>int</i> Index or -1 if no kernels are specialised for nChannels
+*/
+static int GetFrameWidth(int nChannels)
+{
+    for(int nWidth = 0; nWidth < FRAME_WIDTHS; ++nWidth)
+        if(FRAME_WIDTH[nWidth] == nChannels)
+            return nWidth;
+    return -1;
+}
+
+void SelectFrameKernels()
+{
+    g_pMergeKernel = g_aMergeKernels[GetFrameWidth(g_nChannels) + 1];
+}
+
+void ResetRecordPosition()
+{
+    g_lHistoryStart = g_lHeadPos;
+    g_lHistoryEnd = g_lHeadPos;
+    g_lRecordPos = g_lHeadPos - g_nRecordOffset;
+}
+
+void StartDuplex()
+{
+    if(g_pPcmRecord && !g_bLinked)
+        g_bLinked = (0 == snd_pcm_link(g_pPcmPlay, g_pPcmRecord)); //Share start, stop and sample clock with replay device
+    //Fill replay buffer before starting so that captured frames line up with replayed frames from the first sample
+    //Stop filling if read-ahead is not ready rather than queue silence ahead of the audio
+    g_bPriming = true;
+    int64_t lHead;
+    do
+        lHead = g_lHeadPos;
+    while(snd_pcm_avail_update(g_pPcmPlay) >= PERIOD_SIZE && Play() && g_lHeadPos != lHead);
+    g_bPriming = false;
+    snd_pcm_start(g_pPcmPlay); //Also starts record device if linked
+    if(g_pPcmRecord && !g_bLinked)
+        snd_pcm_start(g_pPcmRecord); //Devices on different cards cannot be linked so start as close together as possible
+    //Frame being captured now was heard when replay head was behind by the frames queued for replay plus those captured but not yet read
+    snd_pcm_sframes_t nReplayDelay = 0;
+    snd_pcm_sframes_t nRecordDelay = 0;
+    snd_pcm_delay(g_pPcmPlay, &nReplayDelay);
+    if(g_pPcmRecord)
+        snd_pcm_delay(g_pPcmRecord, &nRecordDelay);
+    g_nRecordOffset = nReplayDelay + nRecordDelay;
+    g_lRecordPos = g_lHeadPos - g_nRecordOffset;
+    eventfd_write(g_fdUiWake, 1);
+}
+
+void StopDuplex()
+{
+    //Discard queued audio but leave devices configured so that next start does not need to reopen them
+    snd_pcm_drop(g_pPcmPlay); //Also stops record device if linked
+    snd_pcm_prepare(g_pPcmPlay);
+    if(g_pPcmRecord && !g_bLinked)
+    {
+        snd_pcm_drop(g_pPcmRecord);
+        snd_pcm_prepare(g_pPcmRecord);
+    }
+}
+
+void RestartDuplex()
+{
+    if(g_bPriming)
+        return; //Devices not yet started
+    StopDuplex();
+    StartDuplex();
+}
+
+void PublishMixer()
+{
+    MixerSnapshot& mixer = g_mixer.GetWriteBuffer();
+    int nChannels = min(g_nChannels, MAX_CHANNELS);
+    for(int i = 0; i < nChannels; ++i)
+    {
+        mixer.pGainA[i] = g_track[i].GetGainA();
+        mixer.pGainB[i] = g_track[i].GetGainB();
+        mixer.pFloatGainA[i] = g_track[i].GetFloatGainA();
+        mixer.pFloatGainB[i] = g_track[i].GetFloatGainB();
+    }
+    for(int i = nChannels; i < MAX_CHANNELS; ++i)
+    {
+        mixer.pGainA[i] = 0;
+        mixer.pGainB[i] = 0;
+        mixer.pFloatGainA[i] = 0;
+        mixer.pFloatGainB[i] = 0;
+    }
+    for(int nLeg = 0; nLeg < 2; ++nLeg)
+    {
+        mixer.pMonitorGainA[nLeg] = g_aMonitor[nLeg].GetGainA();
+        mixer.pMonitorGainB[nLeg] = g_aMonitor[nLeg].GetGainB();
+    }
+    g_mixer.Publish();
+}
+
+void UpdateMixer()
+{
+    //Mute output of tracks being recorded
+    const MixerSnapshot& mixer = g_mixer.GetReadBuffer();
+    bool bRecording = (TC_PLAY == g_nTransport && g_bRecordEnabled && g_pPcmRecord);
+    for(int i = 0; i < MAX_CHANNELS; ++i)
+    {
+        bool bMute = bRecording && (i == g_nRecA || i == g_nRecB);
+        g_pTargetGainA[i] = bMute ? 0 : mixer.pGainA[i];
+        g_pTargetGainB[i] = bMute ? 0 : mixer.pGainB[i];
+        g_pTargetFloatGainA[i] = bMute ? 0 : mixer.pFloatGainA[i];
+        g_pTargetFloatGainB[i] = bMute ? 0 : mixer.pFloatGainB[i];
+    }
+    for(int nLeg = 0; nLeg < 2; ++nLeg)
+    {
+        g_pTargetMonitorA[nLeg] = mixer.pMonitorGainA[nLeg];
+        g_pTargetMonitorB[nLeg] = mixer.pMonitorGainB[nLeg];
+    }
+    if(g_bPlanar)
+    {
+        //Read only tracks that may be heard or are armed - read again from next period if a track not being read becomes audible
+        uint64_t nMask = 0;
+        for(int i = 0; i < min(g_nChannels, MAX_CHANNELS); ++i)
+            if(mixer.pGainA[i] || mixer.pGainB[i] || i == g_nRecA || i == g_nRecB)
+                nMask |= (uint64_t)1 << i;
+        if(nMask & ~g_nPlanarMask.exchange(nMask, memory_order_relaxed))
+            g_bPrefetchReread = true;
+    }
+    g_bMixChanged = true; //Ramp to new gains during next period
+}
+
+void RampMixer()
+{
+    //Gains at end of period are target gains faded by transport
+    int nFade = FADE_UNITY;
+    if(g_nFadeFrames)
+        nFade = (int64_t)g_nFadePos * FADE_UNITY / g_nFadeFrames;
+    float fFade = (float)nFade / FADE_UNITY;
+    int nChannels = min(g_nChannels, MAX_CHANNELS);
+    bool bRamp = false;
+    if(g_bFloat)
+    {
+        memcpy(g_pRampFloatGainA, g_pFloatGainA, sizeof(g_pFloatGainA));
+        memcpy(g_pRampFloatGainB, g_pFloatGainB, sizeof(g_pFloatGainB));
+        for(int i = 0; i < nChannels; ++i)
+        {
+            g_pFloatGainA[i] = g_pTargetFloatGainA[i] * fFade;
+            g_pFloatGainB[i] = g_pTargetFloatGainB[i] * fFade;
+            bRamp |= (g_pFloatGainA[i] != g_pRampFloatGainA[i]) | (g_pFloatGainB[i] != g_pRampFloatGainB[i]);
+        }
+    }
+    else
+    {
+        memcpy(g_pRampGainA, g_pGainA, sizeof(g_pGainA));
+        memcpy(g_pRampGainB, g_pGainB, sizeof(g_pGainB));
+        for(int i = 0; i < nChannels; ++i)
+        {
+            g_pGainA[i] = (g_pTargetGainA[i] * nFade) >> 16;
+            g_pGainB[i] = (g_pTargetGainB[i] * nFade) >> 16;
+            bRamp |= (g_pGainA[i] != g_pRampGainA[i]) | (g_pGainB[i] != g_pRampGainB[i]);
+        }
+    }
+    g_bRamp = bRamp;
+    //Keep checking until fade completes and ramp has finished - next period recompacts without tracks that faded out
+    g_bMixChanged = bRamp || (g_nFadeDir > 0 && g_nFadePos < g_nFadeFrames) || (g_nFadeDir < 0 && g_nFadePos > 0);
+    CompactMixer(!bRamp);
+}
+
+void StartFade(int nDir)
+{
+    g_nFadeDir = nDir;
+    g_bMixChanged = true;
+    if(nDir > 0 && TC_STOP == g_nTransport)
+    {
+        //Start from silence
+        g_nFadePos = 0;
+        memset(g_pGainA, 0, sizeof(g_pGainA));
+        memset(g_pGainB, 0, sizeof(g_pGainB));
+        memset(g_pFloatGainA, 0, sizeof(g_pFloatGainA));
+        memset(g_pFloatGainB, 0, sizeof(g_pFloatGainB));
+        memset(g_pMonitorA, 0, sizeof(g_pMonitorA));
+        memset(g_pMonitorB, 0, sizeof(g_pMonitorB));
+    }
+}
+
+void CompactMixer(bool bCompact)
+{
+    //List channels that can be heard so that mix cost follows audible tracks rather than file width
+    int nChannels = min(g_nChannels, MAX_CHANNELS);
+    g_nActive = 0;
+    for(int i = 0; i < nChannels; ++i)
+        if(g_bFloat ? (g_pFloatGainA[i] || g_pFloatGainB[i]) : (g_pGainA[i] || g_pGainB[i]))
+            g_pActive[g_nActive++] = i;
+    g_bCompact = bCompact && (g_nActive * g_nCompactRatio <= nChannels);
+    if(!g_bCompact)
+    {
+        //Kernel mixing every channel in turn is quicker than hopping between audible ones
+        g_nActive = nChannels;
+        for(int i = 0; i < nChannels; ++i)
+            g_pActive[i] = i;
+    }
+    for(int i = 0; i < g_nActive; ++i)
+    {
+        g_pActiveGainA[i] = g_pGainA[g_pActive[i]];
+        g_pActiveGainB[i] = g_pGainB[g_pActive[i]];
+        g_pActiveFloatGainA[i] = g_pFloatGainA[g_pActive[i]];
+        g_pActiveFloatGainB[i] = g_pFloatGainB[g_pActive[i]];
+    }
+    SetMixGroups();
+}
+
+void SetMixGroups()
+{
+    //Split tracks in to contiguous groups of similar size, one per mix thread, but only as many groups as are worth handing over
+    int nChannels = g_nActive;
+    g_nMixGroups = max(1, min(g_nMixThreads, nChannels / MIX_GROUP_TRACKS));
+    for(int nGroup = 0; nGroup < g_nMixGroups; ++nGroup)
+    {
+        g_aMixGroups[nGroup].nFirst = nChannels * nGroup / g_nMixGroups;
+        g_aMixGroups[nGroup].nLast = nChannels * (nGroup + 1) / g_nMixGroups;
+        g_aMixGroups[nGroup].pKernel = GetMixKernel(g_nMixKernel, g_aMixGroups[nGroup].nLast - g_aMixGroups[nGroup].nFirst);
+        g_apMixBuses[nGroup] = g_aMixGroups[nGroup].pBus;
+        g_apFloatBuses[nGroup] = g_aMixGroups[nGroup].pFloatBus;
+    }
+}
+
+void StartMixers()
+{
+    if(g_nMixThreads < 1)
+        g_nMixThreads = thread::hardware_concurrency();
+    g_nMixThreads = max(1, min(g_nMixThreads, MAX_MIX_THREADS));
+    SetMixGroups();
+    g_fdMixDone = eventfd(0, EFD_NONBLOCK);
+    g_bMixWaiting = false;
+    g_bMixRunning = true;
+    for(int nGroup = 1; nGroup < g_nMixThreads; ++nGroup)
+    {
+        g_aMixGroups[nGroup].fdWake = eventfd(0, EFD_NONBLOCK);
+        g_aMixGroups[nGroup].bSleeping = false;
+        g_aMixGroups[nGroup].nPeriod = g_nMixPeriod; //Thread may start after first period is dispatched
+        g_aMixThreads[nGroup] = thread(MixWorker, nGroup);
+    }
+}
+
+void StopMixers()
+{
+    g_bMixRunning = false;
+    for(int nGroup = 1; nGroup < g_nMixThreads; ++nGroup)
+    {
+        eventfd_write(g_aMixGroups[nGroup].fdWake, 1);
+        g_aMixThreads[nGroup].join();
+        close(g_aMixGroups[nGroup].fdWake);
+    }
+    close(g_fdMixDone);
+}
+
+void MixWorker(int nGroup)
+{
+    if(g_bRealtime)
+        StartRealtime(true); //Mix threads hold up the audio thread so need the same priority
+    if(g_bFloat)
+        SetFlushToZero(true);
+    MixGroup& group = g_aMixGroups[nGroup];
+    unsigned int& nPeriod = group.nPeriod;
+    while(g_bMixRunning)
+    {
+        //Periods arrive in quick succession whilst rolling so spin briefly before sleeping
+        int nSpin = MIX_SPIN;
+        while(g_nMixPeriod.load(memory_order_acquire) == nPeriod && --nSpin > 0)
+            ;
+        if(g_nMixPeriod.load(memory_order_acquire) == nPeriod)
+        {
+            //Audio thread wakes sleeping mix threads - check again after flagging so that a period dispatched meanwhile is not missed
+            group.bSleeping = true;
+            if(g_nMixPeriod.load() == nPeriod && g_bMixRunning)
+            {
+                pollfd pfd = {group.fdWake, POLLIN, 0};
+                poll(&pfd, 1, -1);
+            }
+            group.bSleeping = false;
+            eventfd_t nValue;
+            eventfd_read(group.fdWake, &nValue);
+            continue;
+        }
+        nPeriod = g_nMixPeriod.load(memory_order_acquire);
+        if(nGroup >= g_nMixGroups)
+            continue; //Not enough tracks to need this thread
+        MixGroupTracks(group, g_pMixFrames, g_nMixFrames);
+        if(1 == g_nMixPending.fetch_sub(1) && g_bMixWaiting.exchange(false))
+            eventfd_write(g_fdMixDone, 1); //Last to finish so wake audio thread
+    }
+}
+
+/** Mix channels nChan to nLast of one frame without vector instructions (used by all kernels for channels left over from vectors)
+*   @param  pFrame Frame to mix
+*   @param  nChan Index of first channel to mix - must be an even quantity of channels after first channel in group
+*   @param  nLast Index after last channel to mix
+*   @param  pGainA Gain of each channel to A-leg
+*   @param  pGainB Gain of each channel to B-leg
+*   @param  pMix Pointer to A-leg and B-leg to add to
+*/
+static inline void MixFrameScalar(const unsigned char* pFrame, int nChan, int nLast, const int16_t* pGainA, const int16_t* pGainB, int32_t* pMix)
+{
+    for(; nChan < nLast; nChan += 2)
+    {
+        int16_t nSample = pFrame[SAMPLESIZE * nChan] + (pFrame[SAMPLESIZE * nChan + 1] << 8); //get little endian sample into 16-bit word
+        int32_t nPairA = nSample * pGainA[nChan];
+        int32_t nPairB = nSample * pGainB[nChan];
+        if(nChan + 1 < nLast)
+        {
+            nSample = pFrame[SAMPLESIZE * nChan + 2] + (pFrame[SAMPLESIZE * nChan + 3] << 8);
+            nPairA += nSample * pGainA[nChan + 1];
+            nPairB += nSample * pGainB[nChan + 1];
+        }
+        pMix[0] += nPairA >> GAIN_SHIFT;
+        pMix[1] += nPairB >> GAIN_SHIFT;
+    }
+}
+
+/** Mix kernel for any CPU - WIDTH channels (0 = any) */
+template <int WIDTH> static void MixScalar(const unsigned char* pFrames, int nFrames, int nFrameSize, int nFirst, int nLast, const int16_t* pGainA, const int16_t* pGainB, int32_t* pBus)
+{
+    if(WIDTH)
+        nLast = nFirst + WIDTH; //Fixed trip count lets compiler unroll channel loop
+    for(int nFrame = 0; nFrame < nFrames; ++nFrame)
+    {
+        pBus[2 * nFrame] = 0;
+        pBus[2 * nFrame + 1] = 0;
+        MixFrameScalar(pFrames + nFrame * nFrameSize, nFirst, nLast, pGainA, pGainB, pBus + 2 * nFrame);
+    }
+}
+
+/** Sum and saturate one sample of all buses without vector instructions (used by all pack functions for samples left over from vectors) */
+static inline int16_t PackSample(const int32_t* const* ppBuses, int nBuses, int nSample)
+{
+    int32_t nMix = ppBuses[0][nSample];
+    for(int nBus = 1; nBus < nBuses; ++nBus)
+        nMix += ppBuses[nBus][nSample];
+    return max(-32768, min(32767, nMix));
+}
+
+/** Bus sum and saturate for any CPU */
+static void PackScalar(const int32_t* const* ppBuses, int nBuses, int nSamples, int16_t* pOutput)
+{
+    for(int nSample = 0; nSample < nSamples; ++nSample)
+        pOutput[nSample] = PackSample(ppBuses, nBuses, nSample);
+}
+
+/** Convert one little-endian 16-bit sample to float */
+static inline float ConvertSample(const unsigned char* pSample)
+{
+    return (int16_t)(pSample[0] + (pSample[1] << 8)) * (1.0f / FLOAT_SCALE);
+}
+
+/** Convert a range of channels of each frame to float using a function converting a contiguous run of samples */
+template <void (*RUN)(const unsigned char*, int, float*)> static void ConvertFrames(const unsigned char* pFrames, int nFrames, int nChannels, int nFirst, int nLast, float* pOutput)
+{
+    if(0 == nFirst && nLast == nChannels)
+    {
+        RUN(pFrames, nFrames * nChannels, pOutput); //Whole frames are one contiguous run
+        return;
+    }
+    for(int nFrame = 0; nFrame < nFrames; ++nFrame)
+        RUN(pFrames + (nFrame * nChannels + nFirst) * SAMPLESIZE, nLast - nFirst, pOutput + nFrame * nChannels + nFirst);
+}
+
+/** Convert a run of 16-bit samples to float for any CPU */
+static void ConvertRunScalar(const unsigned char* pSamples, int nSamples, float* pOutput)
+{
+    for(int nSample = 0; nSample < nSamples; ++nSample)
+        pOutput[nSample] = ConvertSample(pSamples + SAMPLESIZE * nSample);
+}
+
+/** 16-bit to float conversion for any CPU */
+static void ConvertScalar(const unsigned char* pFrames, int nFrames, int nChannels, int nFirst, int nLast, float* pOutput)
+{
+    ConvertFrames<ConvertRunScalar>(pFrames, nFrames, nChannels, nFirst, nLast, pOutput);
+}
+
+/** Float mix kernel for any CPU */
+static void FloatMixScalar(const float* pFrames, int nFrames, int nChannels, int nFirst, int nLast, const float* pGainA, const float* pGainB, float* pBus)
+{
+    for(int nFrame = 0; nFrame < nFrames; ++nFrame)
+    {
+        const float* pFrame = pFrames + nFrame * nChannels;
+        float fMixA = 0;
+        float fMixB = 0;
+        for(int nChan = nFirst; nChan < nLast; ++nChan)
+        {
+            fMixA += pFrame[nChan] * pGainA[nChan];
+            fMixB += pFrame[nChan] * pGainB[nChan];
+        }
+        pBus[2 * nFrame] = fMixA;
+        pBus[2 * nFrame + 1] = fMixB;
+    }
+}
+
+/** Sum one sample of all float buses and convert to saturated 16-bit without vector instructions (used by all float pack functions for samples left over from vectors) */
+static inline int16_t FloatPackSample(const float* const* ppBuses, int nBuses, int nSample)
+{
+    float fMix = ppBuses[0][nSample];
+    for(int nBus = 1; nBus < nBuses; ++nBus)
+        fMix += ppBuses[nBus][nSample];
+    return lrintf(max(-FLOAT_SCALE, min(FLOAT_SCALE - 1, fMix * FLOAT_SCALE)));
+}
+
+/** Float bus sum and conversion for any CPU */
+static void FloatPackScalar(const float* const* ppBuses, int nBuses, int nSamples, int16_t* pOutput)
+{
+    for(int nSample = 0; nSample < nSamples; ++nSample)
+        pOutput[nSample] = FloatPackSample(ppBuses, nBuses, nSample);
+}
+
+/** Metering for any CPU - squares are summed in 32-bit integers then added to float readings each METER_CHUNK frames, as vector kernels do, so that readings match */
+static void MeterScalar(const unsigned char* pFrames, int nFrames, int nFrameSize, int nFirst, int nLast, int16_t* pPeak, float* pSquares)
+{
+    for(int nChan = nFirst; nChan < nLast; ++nChan)
+    {
+        int nPeak = pPeak[nChan];
+        float fSquares = pSquares[nChan];
+        const unsigned char* pSample = pFrames + SAMPLESIZE * nChan;
+        for(int nChunk = 0; nChunk < nFrames; nChunk += METER_CHUNK)
+        {
+            int32_t nSquares = 0;
+            int nEnd = min(nFrames, nChunk + METER_CHUNK);
+            for(int nFrame = nChunk; nFrame < nEnd; ++nFrame, pSample += nFrameSize)
+            {
+                int nSample = (int16_t)(pSample[0] + (pSample[1] << 8));
+                nPeak = max(nPeak, min(abs(nSample), (int)METER_CLIP)); //-32768 saturates to full scale like vector kernels
+                nSquares += (nSample * nSample) >> METER_SHIFT;
+            }
+            fSquares += (float)nSquares * (1 << METER_SHIFT);
+        }
+        pPeak[nChan] = nPeak;
+        pSquares[nChan] = fSquares;
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/** Bus sum and saturate for x86 with SSE2 - 8 samples per instruction */
+static __attribute__((target("sse2"))) void PackSse2(const int32_t* const* ppBuses, int nBuses, int nSamples, int16_t* pOutput)
+{
+    int nVector = nSamples / 8 * 8;
+    for(int nSample = 0; nSample < nVector; nSample += 8)
+    {
+        __m128i low = _mm_loadu_si128((const __m128i*)(ppBuses[0] + nSample));
+        __m128i high = _mm_loadu_si128((const __m128i*)(ppBuses[0] + nSample + 4));
+        for(int nBus = 1; nBus < nBuses; ++nBus)
+        {
+            low = _mm_add_epi32(low, _mm_loadu_si128((const __m128i*)(ppBuses[nBus] + nSample)));
+            high = _mm_add_epi32(high, _mm_loadu_si128((const __m128i*)(ppBuses[nBus] + nSample + 4)));
+        }
+        _mm_storeu_si128((__m128i*)(pOutput + nSample), _mm_packs_epi32(low, high));
+    }
+    for(int nSample = nVector; nSample < nSamples; ++nSample)
+        pOutput[nSample] = PackSample(ppBuses, nBuses, nSample);
+}
+
+/** Bus sum and saturate for x86 with AVX2 - 16 samples per instruction */
+static __attribute__((target("avx2"))) void PackAvx2(const int32_t* const* ppBuses, int nBuses, int nSamples, int16_t* pOutput)
+{
+    int nVector = nSamples / 16 * 16;
+    for(int nSample = 0; nSample < nVector; nSample += 16)
+    {
+        __m256i low = _mm256_loadu_si256((const __m256i*)(ppBuses[0] + nSample));
+        __m256i high = _mm256_loadu_si256((const __m256i*)(ppBuses[0] + nSample + 8));
+        for(int nBus = 1; nBus < nBuses; ++nBus)
+        {
+            low = _mm256_add_epi32(low, _mm256_loadu_si256((const __m256i*)(ppBuses[nBus] + nSample)));
+            high = _mm256_add_epi32(high, _mm256_loadu_si256((const __m256i*)(ppBuses[nBus] + nSample + 8)));
+        }
+        //Pack works within each 128-bit lane so reorder 64-bit quarters afterwards
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(low, high), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256((__m256i*)(pOutput + nSample), packed);
+    }
+    for(int nSample = nVector; nSample < nSamples; ++nSample)
+        pOutput[nSample] = PackSample(ppBuses, nBuses, nSample);
+}
+
+/** Add pair products of 8 channels of a frame to A-leg and B-leg accumulators (SSE2) */
+static inline __attribute__((target("sse2"))) void MixVectorSse2(const unsigned char* pSamples, const int16_t* pGainA, const int16_t* pGainB, __m128i& accA, __m128i& accB)
+{
+    __m128i samples = _mm_loadu_si128((const __m128i*)pSamples);
+    accA = _mm_add_epi32(accA, _mm_srai_epi32(_mm_madd_epi16(samples, _mm_loadu_si128((const __m128i*)pGainA)), GAIN_SHIFT));
+    accB = _mm_add_epi32(accB, _mm_srai_epi32(_mm_madd_epi16(samples, _mm_loadu_si128((const __m128i*)pGainB)), GAIN_SHIFT));
+}
+
+/** Add pair products of 16 channels of a frame to A-leg and B-leg accumulators (AVX2) */
+static inline __attribute__((target("avx2"))) void MixVectorAvx2(const unsigned char* pSamples, const int16_t* pGainA, const int16_t* pGainB, __m256i& accA, __m256i& accB)
+{
+    __m256i samples = _mm256_loadu_si256((const __m256i*)pSamples);
+    accA = _mm256_add_epi32(accA, _mm256_srai_epi32(_mm256_madd_epi16(samples, _mm256_loadu_si256((const __m256i*)pGainA)), GAIN_SHIFT));
+    accB = _mm256_add_epi32(accB, _mm256_srai_epi32(_mm256_madd_epi16(samples, _mm256_loadu_si256((const __m256i*)pGainB)), GAIN_SHIFT));
+}
+
+/** Sum the lanes of two frames' accumulators together - reducing frames in pairs halves the shuffles
+*   @return <i>__m128i</i> A-leg and B-leg of first frame then A-leg and B-leg of second frame
+*/
+static inline __attribute__((target("sse2"))) __m128i SumStereoPair(__m128i accA0, __m128i accB0, __m128i accA1, __m128i accB1)
+{
+    __m128i sum0 = _mm_add_epi32(_mm_unpacklo_epi32(accA0, accB0), _mm_unpackhi_epi32(accA0, accB0)); //a0+a2, b0+b2, a1+a3, b1+b3
+    __m128i sum1 = _mm_add_epi32(_mm_unpacklo_epi32(accA1, accB1), _mm_unpackhi_epi32(accA1, accB1));
+    return _mm_add_epi32(_mm_unpacklo_epi64(sum0, sum1), _mm_unpackhi_epi64(sum0, sum1));
+}
+
+/** Store the summed accumulators of a pair of frames then add channels left over from vectors */
+static inline __attribute__((target("sse2"))) void StoreStereoPair(__m128i sum, const unsigned char* pFrame, int nFrameSize, bool bPair, int nChan, int nLast, const int16_t* pGainA, const int16_t* pGainB, int32_t* pMix)
+{
+    if(bPair)
+        _mm_storeu_si128((__m128i*)pMix, sum);
+    else
+        _mm_storel_epi64((__m128i*)pMix, sum);
+    MixFrameScalar(pFrame, nChan, nLast, pGainA, pGainB, pMix);
+    if(bPair)
+        MixFrameScalar(pFrame + nFrameSize, nChan, nLast, pGainA, pGainB, pMix + 2);
+}
+
+/** Mix kernel for x86 with SSE2 - 8 channels per instruction, WIDTH channels (0 = any) */
+template <int WIDTH> static __attribute__((target("sse2"))) void MixSse2(const unsigned char* pFrames, int nFrames, int nFrameSize, int nFirst, int nLast, const int16_t* pGainA, const int16_t* pGainB, int32_t* pBus)
+{
+    if(WIDTH)
+        nLast = nFirst + WIDTH;
+    int nVector = nFirst + (nLast - nFirst) / 8 * 8; //First channel left over from vectors
+    for(int nFrame = 0; nFrame < nFrames; nFrame += 2)
+    {
+        const unsigned char* pFrame = pFrames + nFrame * nFrameSize;
+        bool bPair = (nFrame + 1 < nFrames);
+        const unsigned char* pNext = bPair ? pFrame + nFrameSize : pFrame; //Mix last frame twice if odd quantity of frames
+        __m128i accA0 = _mm_setzero_si128();
+        __m128i accB0 = _mm_setzero_si128();
+        __m128i accA1 = _mm_setzero_si128();
+        __m128i accB1 = _mm_setzero_si128();
+        for(int nChan = nFirst; nChan < nVector; nChan += 8)
+        {
+            MixVectorSse2(pFrame + SAMPLESIZE * nChan, pGainA + nChan, pGainB + nChan, accA0, accB0);
+            MixVectorSse2(pNext + SAMPLESIZE * nChan, pGainA + nChan, pGainB + nChan, accA1, accB1);
+        }
+        StoreStereoPair(SumStereoPair(accA0, accB0, accA1, accB1), pFrame, nFrameSize, bPair, nVector, nLast, pGainA, pGainB, pBus + 2 * nFrame);
+    }
+}
+
+/** Mix kernel for x86 with AVX2 - 16 channels per instruction, WIDTH channels (0 = any) */
+template <int WIDTH> static __attribute__((target("avx2"))) void MixAvx2(const unsigned char* pFrames, int nFrames, int nFrameSize, int nFirst, int nLast, const int16_t* pGainA, const int16_t* pGainB, int32_t* pBus)
+{
+    if(WIDTH)
+        nLast = nFirst + WIDTH;
+    int nWide = nFirst + (nLast - nFirst) / 16 * 16; //First channel left over from 16 channel vectors
+    int nVector = nFirst + (nLast - nFirst) / 8 * 8; //First channel left over from 8 channel vectors
+    for(int nFrame = 0; nFrame < nFrames; nFrame += 2)
+    {
+        const unsigned char* pFrame = pFrames + nFrame * nFrameSize;
+        bool bPair = (nFrame + 1 < nFrames);
+        const unsigned char* pNext = bPair ? pFrame + nFrameSize : pFrame; //Mix last frame twice if odd quantity of frames
+        __m256i accWideA0 = _mm256_setzero_si256();
+        __m256i accWideB0 = _mm256_setzero_si256();
+        __m256i accWideA1 = _mm256_setzero_si256();
+        __m256i accWideB1 = _mm256_setzero_si256();
+        for(int nChan = nFirst; nChan < nWide; nChan += 16)
+        {
+            MixVectorAvx2(pFrame + SAMPLESIZE * nChan, pGainA + nChan, pGainB + nChan, accWideA0, accWideB0);
+            MixVectorAvx2(pNext + SAMPLESIZE * nChan, pGainA + nChan, pGainB + nChan, accWideA1, accWideB1);
+        }
+        __m128i accA0 = _mm_add_epi32(_mm256_castsi256_si128(accWideA0), _mm256_extracti128_si256(accWideA0, 1));
+        __m128i accB0 = _mm_add_epi32(_mm256_castsi256_si128(accWideB0), _mm256_extracti128_si256(accWideB0, 1));
+        __m128i accA1 = _mm_add_epi32(_mm256_castsi256_si128(accWideA1), _mm256_extracti128_si256(accWideA1, 1));
+        __m128i accB1 = _mm_add_epi32(_mm256_castsi256_si128(accWideB1), _mm256_extracti128_si256(accWideB1, 1));
+        if(nWide < nVector)
+        {
+            MixVectorSse2(pFrame + SAMPLESIZE * nWide, pGainA + nWide, pGainB + nWide, accA0, accB0);
+            MixVectorSse2(pNext + SAMPLESIZE * nWide, pGainA + nWide, pGainB + nWide, accA1, accB1);
+        }
+        StoreStereoPair(SumStereoPair(accA0, accB0, accA1, accB1), pFrame, nFrameSize, bPair, nVector, nLast, pGainA, pGainB, pBus + 2 * nFrame);
+    }
+}
+/** Convert a run of 16-bit samples to float for x86 with SSE2 - 8 samples per instruction */
+static __attribute__((target("sse2"))) void ConvertRunSse2(const unsigned char* pSamples, int nSamples, float* pOutput)
+{
+    int nVector = nSamples / 8 * 8;
+    __m128 scale = _mm_set1_ps(1.0f / FLOAT_SCALE);
+    for(int nSample = 0; nSample < nVector; nSample += 8)
+    {
+        __m128i samples = _mm_loadu_si128((const __m128i*)(pSamples + SAMPLESIZE * nSample));
+        __m128i low = _mm_srai_epi32(_mm_unpacklo_epi16(samples, samples), 16); //sign extend
+        __m128i high = _mm_srai_epi32(_mm_unpackhi_epi16(samples, samples), 16);
+        _mm_storeu_ps(pOutput + nSample, _mm_mul_ps(_mm_cvtepi32_ps(low), scale));
+        _mm_storeu_ps(pOutput + nSample + 4, _mm_mul_ps(_mm_cvtepi32_ps(high), scale));
+    }
+    ConvertRunScalar(pSamples + SAMPLESIZE * nVector, nSamples - nVector, pOutput + nVector);
+}
+
+/** 16-bit to float conversion for x86 with SSE2 */
+static void ConvertSse2(const unsigned char* pFrames, int nFrames, int nChannels, int nFirst, int nLast, float* pOutput)
+{
+    ConvertFrames<ConvertRunSse2>(pFrames, nFrames, nChannels, nFirst, nLast, pOutput);
+}
+
+/** Convert a run of 16-bit samples to float for x86 with AVX2 - 8 samples per instruction */
+static __attribute__((target("avx2"))) void ConvertRunAvx2(const unsigned char* pSamples, int nSamples, float* pOutput)
+{
+    int nVector = nSamples / 8 * 8;
+    __m256 scale = _mm256_set1_ps(1.0f / FLOAT_SCALE);
+    for(int nSample = 0; nSample < nVector; nSample += 8)
+    {
+        __m256i samples = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(pSamples + SAMPLESIZE * nSample)));
+        _mm256_storeu_ps(pOutput + nSample, _mm256_mul_ps(_mm256_cvtepi32_ps(samples), scale));
+    }
+    ConvertRunScalar(pSamples + SAMPLESIZE * nVector, nSamples - nVector, pOutput + nVector);
+}
+
+/** 16-bit to float conversion for x86 with AVX2 */
+static void ConvertAvx2(const unsigned char* pFrames, int nFrames, int nChannels, int nFirst, int nLast, float* pOutput)
+{
+    ConvertFrames<ConvertRunAvx2>(pFrames, nFrames, nChannels, nFirst, nLast, pOutput);
+}
+
+/** Sum the lanes of a frame's float accumulators and store A-leg and B-leg then add channels left over from vectors */
+static inline __attribute__((target("sse2"))) void StoreFloatStereo(__m128 accA, __m128 accB, const float* pFrame, int nChan, int nLast, const float* pGainA, const float* pGainB, float* pMix)
+{
+    __m128 sum = _mm_add_ps(_mm_unpacklo_ps(accA, accB), _mm_unpackhi_ps(accA, accB)); //a0+a2, b0+b2, a1+a3, b1+b3
+    _mm_storel_pi((__m64*)pMix, _mm_add_ps(sum, _mm_movehl_ps(sum, sum)));
+    for(; nChan < nLast; ++nChan)
+    {
+        pMix[0] += pFrame[nChan] * pGainA[nChan];
+        pMix[1] += pFrame[nChan] * pGainB[nChan];
+    }
+}
+
+/** Float mix kernel for x86 with SSE2 - 4 channels per instruction */
+static __attribute__((target("sse2"))) void FloatMixSse2(const float* pFrames, int nFrames, int nChannels, int nFirst, int nLast, const float* pGainA, const float* pGainB, float* pBus)
+{
+    int nVector = nFirst + (nLast - nFirst) / 4 * 4; //First channel left over from vectors
+    for(int nFrame = 0; nFrame < nFrames; ++nFrame)
+    {
+        const float* pFrame = pFrames + nFrame * nChannels;
+        __m128 accA = _mm_setzero_ps();
+        __m128 accB = _mm_setzero_ps();
+        for(int nChan = nFirst; nChan < nVector; nChan += 4)
+        {
+            __m128 samples = _mm_loadu_ps(pFrame + nChan);
+            accA = _mm_add_ps(accA, _mm_mul_ps(samples, _mm_loadu_ps(pGainA + nChan)));
+            accB = _mm_add_ps(accB, _mm_mul_ps(samples, _mm_loadu_ps(pGainB + nChan)));
+        }
+        StoreFloatStereo(accA, accB, pFrame, nVector, nLast, pGainA, pGainB, pBus + 2 * nFrame);
+    }
+}
+
+/** Float mix kernel for x86 with AVX2 - 8 channels per instruction */
+static __attribute__((target("avx2"))) void FloatMixAvx2(const float* pFrames, int nFrames, int nChannels, int nFirst, int nLast, const float* pGainA, const float* pGainB, float* pBus)
+{
+    int nWide = nFirst + (nLast - nFirst) / 8 * 8; //First channel left over from 8 channel vectors
+    int nVector = nFirst + (nLast - nFirst) / 4 * 4; //First channel left over from 4 channel vectors
+    for(int nFrame = 0; nFrame < nFrames; ++nFrame)
+    {
+        const float* pFrame = pFrames + nFrame * nChannels;
+        __m256 accWideA = _mm256_setzero_ps();
+        __m256 accWideB = _mm256_setzero_ps();
+        for(int nChan = nFirst; nChan < nWide; nChan += 8)
+        {
+            __m256 samples = _mm256_loadu_ps(pFrame + nChan);
+            accWideA = _mm256_add_ps(accWideA, _mm256_mul_ps(samples, _mm256_loadu_ps(pGainA + nChan)));
+            accWideB = _mm256_add_ps(accWideB, _mm256_mul_ps(samples, _mm256_loadu_ps(pGainB + nChan)));
+        }
+        __m128 accA = _mm_add_ps(_mm256_castps256_ps128(accWideA), _mm256_extractf128_ps(accWideA, 1));
+        __m128 accB = _mm_add_ps(_mm256_castps256_ps128(accWideB), _mm256_extractf128_ps(accWideB, 1));
+        if(nWide < nVector)
+        {
+            __m128 samples = _mm_loadu_ps(pFrame + nWide);
+            accA = _mm_add_ps(accA, _mm_mul_ps(samples, _mm_loadu_ps(pGainA + nWide)));
+            accB = _mm_add_ps(accB, _mm_mul_ps(samples, _mm_loadu_ps(pGainB + nWide)));
+        }
+        StoreFloatStereo(accA, accB, pFrame, nVector, nLast, pGainA, pGainB, pBus + 2 * nFrame);
+    }
+}
+
+/** Float bus sum and conversion for x86 with SSE2 - 8 samples per instruction */
+static __attribute__((target("sse2"))) void FloatPackSse2(const float* const* ppBuses, int nBuses, int nSamples, int16_t* pOutput)
+{
+    int nVector = nSamples / 8 * 8;
+    __m128 scale = _mm_set1_ps(FLOAT_SCALE);
+    __m128 minimum = _mm_set1_ps(-FLOAT_SCALE);
+    __m128 maximum = _mm_set1_ps(FLOAT_SCALE - 1); //Clamp before conversion because out of range floats convert to INT_MIN
+    for(int nSample = 0; nSample < nVector; nSample += 8)
+    {
+        __m128 low = _mm_loadu_ps(ppBuses[0] + nSample);
+        __m128 high = _mm_loadu_ps(ppBuses[0] + nSample + 4);
+        for(int nBus = 1; nBus < nBuses; ++nBus)
+        {
+            low = _mm_add_ps(low, _mm_loadu_ps(ppBuses[nBus] + nSample));
+            high = _mm_add_ps(high, _mm_loadu_ps(ppBuses[nBus] + nSample + 4));
+        }
+        low = _mm_min_ps(_mm_max_ps(_mm_mul_ps(low, scale), minimum), maximum);
+        high = _mm_min_ps(_mm_max_ps(_mm_mul_ps(high, scale), minimum), maximum);
+        _mm_storeu_si128((__m128i*)(pOutput + nSample), _mm_packs_epi32(_mm_cvtps_epi32(low), _mm_cvtps_epi32(high)));
+    }
+    for(int nSample = nVector; nSample < nSamples; ++nSample)
+        pOutput[nSample] = FloatPackSample(ppBuses, nBuses, nSample);
+}
+
+/** Float bus sum and conversion for x86 with AVX2 - 16 samples per instruction */
+static __attribute__((target("avx2"))) void FloatPackAvx2(const float* const* ppBuses, int nBuses, int nSamples, int16_t* pOutput)
+{
+    int nVector = nSamples / 16 * 16;
+    __m256 scale = _mm256_set1_ps(FLOAT_SCALE);
+    __m256 minimum = _mm256_set1_ps(-FLOAT_SCALE);
+    __m256 maximum = _mm256_set1_ps(FLOAT_SCALE - 1);
+    for(int nSample = 0; nSample < nVector; nSample += 16)
+    {
+        __m256 low = _mm256_loadu_ps(ppBuses[0] + nSample);
+        __m256 high = _mm256_loadu_ps(ppBuses[0] + nSample + 8);
+        for(int nBus = 1; nBus < nBuses; ++nBus)
+        {
+            low = _mm256_add_ps(low, _mm256_loadu_ps(ppBuses[nBus] + nSample));
+            high = _mm256_add_ps(high, _mm256_loadu_ps(ppBuses[nBus] + nSample + 8));
+        }
+        low = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(low, scale), minimum), maximum);
+        high = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(high, scale), minimum), maximum);
+        __m256i packed = _mm256_packs_epi32(_mm256_cvtps_epi32(low), _mm256_cvtps_epi32(high)); //Packs within 128-bit lanes
+        _mm256_storeu_si256((__m256i*)(pOutput + nSample), _mm256_permute4x64_epi64(packed, 0xD8));
+    }
+    for(int nSample = nVector; nSample < nSamples; ++nSample)
+        pOutput[nSample] = FloatPackSample(ppBuses, nBuses, nSample);
+}
+/** Metering for x86 with SSE2 - 8 channels per instruction */
+static __attribute__((target("sse2"))) void MeterSse2(const unsigned char* pFrames, int nFrames, int nFrameSize, int nFirst, int nLast, int16_t* pPeak, float* pSquares)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 scale = _mm_set1_ps(1 << METER_SHIFT);
+    int nChan = nFirst;
+    for(; nChan + 8 <= nLast; nChan += 8)
+    {
+        //Walk down each vector of channels through the period so that readings stay in registers
+        __m128i peak = _mm_loadu_si128((const __m128i*)(pPeak + nChan));
+        __m128 squaresLow = _mm_loadu_ps(pSquares + nChan);
+        __m128 squaresHigh = _mm_loadu_ps(pSquares + nChan + 4);
+        const unsigned char* pSamples = pFrames + SAMPLESIZE * nChan;
+        for(int nChunk = 0; nChunk < nFrames; nChunk += METER_CHUNK)
+        {
+            __m128i sumLow = zero;
+            __m128i sumHigh = zero;
+            int nEnd = min(nFrames, nChunk + METER_CHUNK);
+            for(int nFrame = nChunk; nFrame < nEnd; ++nFrame, pSamples += nFrameSize)
+            {
+                __m128i samples = _mm_loadu_si128((const __m128i*)pSamples);
+                peak = _mm_max_epi16(peak, _mm_max_epi16(samples, _mm_subs_epi16(zero, samples)));
+                //Each sample paired with zero so that multiply-add gives its exact square
+                __m128i low = _mm_unpacklo_epi16(samples, zero);
+                __m128i high = _mm_unpackhi_epi16(samples, zero);
+                sumLow = _mm_add_epi32(sumLow, _mm_srli_epi32(_mm_madd_epi16(low, low), METER_SHIFT));
+                sumHigh = _mm_add_epi32(sumHigh, _mm_srli_epi32(_mm_madd_epi16(high, high), METER_SHIFT));
+            }
+            squaresLow = _mm_add_ps(squaresLow, _mm_mul_ps(_mm_cvtepi32_ps(sumLow), scale));
+            squaresHigh = _mm_add_ps(squaresHigh, _mm_mul_ps(_mm_cvtepi32_ps(sumHigh), scale));
+        }
+        _mm_storeu_si128((__m128i*)(pPeak + nChan), peak);
+        _mm_storeu_ps(pSquares + nChan, squaresLow);
+        _mm_storeu_ps(pSquares + nChan + 4, squaresHigh);
+    }
+    MeterScalar(pFrames, nFrames, nFrameSize, nChan, nLast, pPeak, pSquares);
+}
+
+/** Metering for x86 with AVX2 - 16 channels per instruction */
+static __attribute__((target("avx2"))) void MeterAvx2(const unsigned char* pFrames, int nFrames, int nFrameSize, int nFirst, int nLast, int16_t* pPeak, float* pSquares)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256 scale = _mm256_set1_ps(1 << METER_SHIFT);
+    int nChan = nFirst;
+    for(; nChan + 16 <= nLast; nChan += 16)
+    {
+        __m256i peak = _mm256_loadu_si256((const __m256i*)(pPeak + nChan));
+        __m256 squaresLow = _mm256_loadu_ps(pSquares + nChan);
+        __m256 squaresHigh = _mm256_loadu_ps(pSquares + nChan + 8);
+        const unsigned char* pSamples = pFrames + SAMPLESIZE * nChan;
+        for(int nChunk = 0; nChunk < nFrames; nChunk += METER_CHUNK)
+        {
+            __m256i sumLow = zero;
+            __m256i sumHigh = zero;
+            int nEnd = min(nFrames, nChunk + METER_CHUNK);
+            for(int nFrame = nChunk; nFrame < nEnd; ++nFrame, pSamples += nFrameSize)
+            {
+                __m256i samples = _mm256_loadu_si256((const __m256i*)pSamples);
+                peak = _mm256_max_epi16(peak, _mm256_max_epi16(samples, _mm256_subs_epi16(zero, samples)));
+                __m256i low = _mm256_unpacklo_epi16(samples, zero);
+                __m256i high = _mm256_unpackhi_epi16(samples, zero);
+                sumLow = _mm256_add_epi32(sumLow, _mm256_srli_epi32(_mm256_madd_epi16(low, low), METER_SHIFT));
+                sumHigh = _mm256_add_epi32(sumHigh, _mm256_srli_epi32(_mm256_madd_epi16(high, high), METER_SHIFT));
+            }
+            //Unpack works within each 128-bit lane so sums are channels 0-3, 8-11 and 4-7, 12-15 - reorder lanes
+            __m256i sum0 = _mm256_permute2x128_si256(sumLow, sumHigh, 0x20);
+            __m256i sum1 = _mm256_permute2x128_si256(sumLow, sumHigh, 0x31);
+            squaresLow = _mm256_add_ps(squaresLow, _mm256_mul_ps(_mm256_cvtepi32_ps(sum0), scale));
+            squaresHigh = _mm256_add_ps(squaresHigh, _mm256_mul_ps(_mm256_cvtepi32_ps(sum1), scale));
+        }
+        _mm256_storeu_si256((__m256i*)(pPeak + nChan), peak);
+        _mm256_storeu_ps(pSquares + nChan, squaresLow);
+        _mm256_storeu_ps(pSquares + nChan + 8, squaresHigh);
+    }
+    MeterSse2(pFrames, nFrames, nFrameSize, nChan, nLast, pPeak, pSquares);
+}
+#endif //x86
+
+#ifdef __ARM_NEON
+/** Mix kernel for ARM with NEON - 8 channels per instruction, WIDTH channels (0 = any) */
+template <int WIDTH> static void MixNeon(const unsigned char* pFrames, int nFrames, int nFrameSize, int nFirst, int nLast, const int16_t* pGainA, const int16_t* pGainB, int32_t* pBus)
+{
+    if(WIDTH)
+        nLast = nFirst + WIDTH;
+    int nVector = nFirst + (nLast - nFirst) / 8 * 8; //First channel left over from vectors
+    for(int nFrame = 0; nFrame < nFrames; ++nFrame)
+    {
+        const unsigned char* pFrame = pFrames + nFrame * nFrameSize;
+        int32x4_t accA = vdupq_n_s32(0);
+        int32x4_t accB = vdupq_n_s32(0);
+        for(int nChan = nFirst; nChan < nVector; nChan += 8)
+        {
+            //Widening multiplies then pairwise add matches SSE2 madd
+            int16x8_t samples = vld1q_s16((const int16_t*)(pFrame + SAMPLESIZE * nChan));
+            int16x8_t gainA = vld1q_s16(pGainA + nChan);
+            int16x8_t gainB = vld1q_s16(pGainB + nChan);
+            int32x4_t lowA = vmull_s16(vget_low_s16(samples), vget_low_s16(gainA));
+            int32x4_t highA = vmull_s16(vget_high_s16(samples), vget_high_s16(gainA));
+            int32x4_t lowB = vmull_s16(vget_low_s16(samples), vget_low_s16(gainB));
+            int32x4_t highB = vmull_s16(vget_high_s16(samples), vget_high_s16(gainB));
+            int32x4_t pairsA = vcombine_s32(vpadd_s32(vget_low_s32(lowA), vget_high_s32(lowA)), vpadd_s32(vget_low_s32(highA), vget_high_s32(highA)));
+            int32x4_t pairsB = vcombine_s32(vpadd_s32(vget_low_s32(lowB), vget_high_s32(lowB)), vpadd_s32(vget_low_s32(highB), vget_high_s32(highB)));
+            accA = vsraq_n_s32(accA, pairsA, GAIN_SHIFT);
+            accB = vsraq_n_s32(accB, pairsB, GAIN_SHIFT);
+        }
+        int32x2_t sumA = vpadd_s32(vget_low_s32(accA), vget_high_s32(accA));
+        int32x2_t sumB = vpadd_s32(vget_low_s32(accB), vget_high_s32(accB));
+        vst1_s32(pBus + 2 * nFrame, vpadd_s32(sumA, sumB));
+        MixFrameScalar(pFrame, nVector, nLast, pGainA, pGainB, pBus + 2 * nFrame);
+    }
+}
+
+/** Bus sum and saturate for ARM with NEON - 8 samples per instruction */
+static void PackNeon(const int32_t* const* ppBuses, int nBuses, int nSamples, int16_t* pOutput)
+{
+    int nVector = nSamples / 8 * 8;
+    for(int nSample = 0; nSample < nVector; nSample += 8)
+    {
+        int32x4_t low = vld1q_s32(ppBuses[0] + nSample);
+        int32x4_t high = vld1q_s32(ppBuses[0] + nSample + 4);
+        for(int nBus = 1; nBus < nBuses; ++nBus)
+        {
+            low = vaddq_s32(low, vld1q_s32(ppBuses[nBus] + nSample));
+            high = vaddq_s32(high, vld1q_s32(ppBuses[nBus] + nSample + 4));
+        }
+        vst1q_s16(pOutput + nSample, vcombine_s16(vqmovn_s32(low), vqmovn_s32(high)));
+    }
+    for(int nSample = nVector; nSample < nSamples; ++nSample)
+        pOutput[nSample] = PackSample(ppBuses, nBuses, nSample);
+}
+/** Convert a run of 16-bit samples to float for ARM with NEON - 8 samples per instruction */
+static void ConvertRunNeon(const unsigned char* pSamples, int nSamples, float* pOutput)
+{
+    int nVector = nSamples / 8 * 8;
+    for(int nSample = 0; nSample < nVector; nSample += 8)
+    {
+        int16x8_t samples = vld1q_s16((const int16_t*)(pSamples + SAMPLESIZE * nSample));
+        vst1q_f32(pOutput + nSample, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(samples))), 1.0f / FLOAT_SCALE));
+        vst1q_f32(pOutput + nSample + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(samples))), 1.0f / FLOAT_SCALE));
+    }
+    ConvertRunScalar(pSamples + SAMPLESIZE * nVector, nSamples - nVector, pOutput + nVector);
+}
+
+/** 16-bit to float conversion for ARM with NEON */
+static void ConvertNeon(const unsigned char* pFrames, int nFrames, int nChannels, int nFirst, int nLast, float* pOutput)
+{
+    ConvertFrames<ConvertRunNeon>(pFrames, nFrames, nChannels, nFirst, nLast, pOutput);
+}
+
+/** Float mix kernel for ARM with NEON - 4 channels per instruction */
+static void FloatMixNeon(const float* pFrames, int nFrames, int nChannels, int nFirst, int nLast, const float* pGainA, const float* pGainB, float* pBus)
+{
+    int nVector = nFirst + (nLast - nFirst) / 4 * 4; //First channel left over from vectors
+    for(int nFrame = 0; nFrame < nFrames; ++nFrame)
+    {
+        const float* pFrame = pFrames + nFrame * nChannels;
+        float32x4_t accA = vdupq_n_f32(0);
+        float32x4_t accB = vdupq_n_f32(0);
+        for(int nChan = nFirst; nChan < nVector; nChan += 4)
+        {
+            float32x4_t samples = vld1q_f32(pFrame + nChan);
+            accA = vmlaq_f32(accA, samples, vld1q_f32(pGainA + nChan));
+            accB = vmlaq_f32(accB, samples, vld1q_f32(pGainB + nChan));
+        }
+        float32x2_t sumA = vpadd_f32(vget_low_f32(accA), vget_high_f32(accA));
+        float32x2_t sumB = vpadd_f32(vget_low_f32(accB), vget_high_f32(accB));
+        vst1_f32(pBus + 2 * nFrame, vpadd_f32(sumA, sumB));
+        for(int nChan = nVector; nChan < nLast; ++nChan)
+        {
+            pBus[2 * nFrame] += pFrame[nChan] * pGainA[nChan];
+            pBus[2 * nFrame + 1] += pFrame[nChan] * pGainB[nChan];
+        }
+    }
+}
+
+/** Round float vector to nearest integer (ARMv7 only converts towards zero) */
+static inline int32x4_t RoundNeon(float32x4_t values)
+{
+#ifdef __aarch64__
+    return vcvtnq_s32_f32(values);
+#else
+    uint32x4_t sign = vandq_u32(vreinterpretq_u32_f32(values), vdupq_n_u32(0x80000000));
+    return vcvtq_s32_f32(vaddq_f32(values, vreinterpretq_f32_u32(vorrq_u32(sign, vreinterpretq_u32_f32(vdupq_n_f32(0.5f))))));
+#endif
+}
+
+/** Float bus sum and conversion for ARM with NEON - 8 samples per instruction */
+static void FloatPackNeon(const float* const* ppBuses, int nBuses, int nSamples, int16_t* pOutput)
+{
+    int nVector = nSamples / 8 * 8;
+    for(int nSample = 0; nSample < nVector; nSample += 8)
+    {
+        float32x4_t low = vld1q_f32(ppBuses[0] + nSample);
+        float32x4_t high = vld1q_f32(ppBuses[0] + nSample + 4);
+        for(int nBus = 1; nBus < nBuses; ++nBus)
+        {
+            low = vaddq_f32(low, vld1q_f32(ppBuses[nBus] + nSample));
+            high = vaddq_f32(high, vld1q_f32(ppBuses[nBus] + nSample + 4));
+        }
+        //Saturating narrow clips anything beyond 16-bit
+        vst1q_s16(pOutput + nSample, vcombine_s16(vqmovn_s32(RoundNeon(vmulq_n_f32(low, FLOAT_SCALE))), vqmovn_s32(RoundNeon(vmulq_n_f32(high, FLOAT_SCALE)))));
+    }
+    for(int nSample = nVector; nSample < nSamples; ++nSample)
+        pOutput[nSample] = FloatPackSample(ppBuses, nBuses, nSample);
+}
+
+/** Metering for ARM with NEON - 8 channels per instruction */
+static void MeterNeon(const unsigned char* pFrames, int nFrames, int nFrameSize, int nFirst, int nLast, int16_t* pPeak, float* pSquares)
+{
+    int nChan = nFirst;
+    for(; nChan + 8 <= nLast; nChan += 8)
+    {
+        int16x8_t peak = vld1q_s16(pPeak + nChan);
+        float32x4_t squaresLow = vld1q_f32(pSquares + nChan);
+        float32x4_t squaresHigh = vld1q_f32(pSquares + nChan + 4);
+        const unsigned char* pSamples = pFrames + SAMPLESIZE * nChan;
+        for(int nChunk = 0; nChunk < nFrames; nChunk += METER_CHUNK)
+        {
+            int32x4_t sumLow = vdupq_n_s32(0);
+            int32x4_t sumHigh = vdupq_n_s32(0);
+            int nEnd = min(nFrames, nChunk + METER_CHUNK);
+            for(int nFrame = nChunk; nFrame < nEnd; ++nFrame, pSamples += nFrameSize)
+            {
+                int16x8_t samples = vld1q_s16((const int16_t*)pSamples);
+                peak = vmaxq_s16(peak, vqabsq_s16(samples));
+                sumLow = vsraq_n_s32(sumLow, vmull_s16(vget_low_s16(samples), vget_low_s16(samples)), METER_SHIFT);
+                sumHigh = vsraq_n_s32(sumHigh, vmull_s16(vget_high_s16(samples), vget_high_s16(samples)), METER_SHIFT);
+            }
+            squaresLow = vmlaq_n_f32(squaresLow, vcvtq_f32_s32(sumLow), 1 << METER_SHIFT);
+            squaresHigh = vmlaq_n_f32(squaresHigh, vcvtq_f32_s32(sumHigh), 1 << METER_SHIFT);
+        }
+        vst1q_s16(pPeak + nChan, peak);
+        vst1q_f32(pSquares + nChan, squaresLow);
+        vst1q_f32(pSquares + nChan + 4, squaresHigh);
+    }
+    MeterScalar(pFrames, nFrames, nFrameSize, nChan, nLast, pPeak, pSquares);
+}
+#endif //__ARM_NEON
+
+/** Available mix kernels, slowest first - bSupported populated by SelectMixKernel */
+static MixKernelInfo g_aMixKernels[] =
+{
+    {"scalar", MixScalar<0>, FRAME_WIDTH_KERNELS(MixScalar), PackScalar, ConvertScalar, FloatMixScalar, FloatPackScalar, MeterScalar, 1, true},
+#if defined(__x86_64__) || defined(__i386__)
+    {"SSE2", MixSse2<0>, FRAME_WIDTH_KERNELS(MixSse2), PackSse2, ConvertSse2, FloatMixSse2, FloatPackSse2, MeterSse2, 8, false},
+    {"AVX2", MixAvx2<0>, FRAME_WIDTH_KERNELS(MixAvx2), PackAvx2, ConvertAvx2, FloatMixAvx2, FloatPackAvx2, MeterAvx2, 8, false},
+#endif
+#ifdef __ARM_NEON
+    {"NEON", MixNeon<0>, FRAME_WIDTH_KERNELS(MixNeon), PackNeon, ConvertNeon, FloatMixNeon, FloatPackNeon, MeterNeon, 4, true}, //Compiled for a CPU with NEON
+#endif
+};
+static const int MIX_KERNELS = sizeof(g_aMixKernels) / sizeof(MixKernelInfo);
+
+void SelectMixKernel()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    g_aMixKernels[1].bSupported = __builtin_cpu_supports("sse2");
+    g_aMixKernels[2].bSupported = __builtin_cpu_supports("avx2");
+#endif
+    for(int nKernel = 0; nKernel < MIX_KERNELS; ++nKernel)
+        if(g_aMixKernels[nKernel].bSupported)
+        {
+            g_nMixKernel = nKernel;
+            g_pPackKernel = g_aMixKernels[nKernel].pPack;
+            g_pConvertKernel = g_aMixKernels[nKernel].pConvert;
+            g_pFloatMixKernel = g_aMixKernels[nKernel].pFloatMix;
+            g_pFloatPackKernel = g_aMixKernels[nKernel].pFloatPack;
+            g_pMeterKernel = g_aMixKernels[nKernel].pMeter;
+            g_nCompactRatio = g_aMixKernels[nKernel].nCompactRatio;
+        }
+}
+
+/** Crossfade linearly from a mix with gains at start of period to a mix with gains at end of period, reaching end gains on last frame
+*   @param  pFrom Mix with start gains
+*   @param  pBus Mix with end gains, replaced with crossfade
+*   @param  nFrames Quantity of frames
+*/
+static void RampBus(const int32_t* pFrom, int32_t* pBus, int nFrames)
+{
+    //Step position by RAMP_UNITY / nFrames, carrying the remainder so that position reaches RAMP_UNITY exactly without dividing each frame
+    int nStep = RAMP_UNITY / nFrames;
+    int nRemainder = RAMP_UNITY % nFrames;
+    int nPos = 0;
+    int nCarry = 0;
+    for(int nFrame = 0; nFrame < nFrames; ++nFrame)
+    {
+        nPos += nStep;
+        nCarry += nRemainder;
+        if(nCarry >= nFrames)
+        {
+            ++nPos;
+            nCarry -= nFrames;
+        }
+        pBus[2 * nFrame] = pFrom[2 * nFrame] + (pBus[2 * nFrame] - pFrom[2 * nFrame]) * nPos / RAMP_UNITY;
+        pBus[2 * nFrame + 1] = pFrom[2 * nFrame + 1] + (pBus[2 * nFrame + 1] - pFrom[2 * nFrame + 1]) * nPos / RAMP_UNITY;
+    }
+}
+
+/** Crossfade linearly between float mixes with gains at start and end of period */
+static void RampFloatBus(const float* pFrom, float* pBus, int nFrames)
+{
+    float fStep = 1.0f / nFrames;
+    for(int nFrame = 0; nFrame < nFrames; ++nFrame)
+    {
+        float fPos = (nFrame + 1) * fStep;
+        pBus[2 * nFrame] = pFrom[2 * nFrame] + (pBus[2 * nFrame] - pFrom[2 * nFrame]) * fPos;
+        pBus[2 * nFrame + 1] = pFrom[2 * nFrame + 1] + (pBus[2 * nFrame + 1] - pFrom[2 * nFrame + 1]) * fPos;
+    }
+}
+
+MixKernel GetMixKernel(int nKernel, int nChannels)
+{
+    int nWidth = GetFrameWidth(nChannels);
+    if(nWidth < 0)
+        return g_aMixKernels[nKernel].pKernel;
+    return g_aMixKernels[nKernel].apWidth[nWidth];
+}
+
+void MixGroupTracks(MixGroup& group, const unsigned char* pFrames, int nFrames)
+{
+    if(g_bMeterPeriod)
+        MeterGroupTracks(group, pFrames, nFrames); //Metered frames are then in cache for mixing
+    if(g_bFloat)
+    {
+        MixGroupFloat(group, pFrames, nFrames);
+        return;
+    }
+    if(g_bRamp)
+    {
+        //Mix is linear in gain so mixing with start and end gains then crossfading gives exact linear gain ramps from unchanged kernels
+        group.pKernel(pFrames, nFrames, g_nFrameSize, group.nFirst, group.nLast, g_pRampGainA, g_pRampGainB, group.pRampBus);
+        group.pKernel(pFrames, nFrames, g_nFrameSize, group.nFirst, group.nLast, g_pActiveGainA, g_pActiveGainB, group.pBus);
+        RampBus(group.pRampBus, group.pBus, nFrames);
+        return;
+    }
+    if(!g_bCompact)
+    {
+        group.pKernel(pFrames, nFrames, g_nFrameSize, group.nFirst, group.nLast, g_pActiveGainA, g_pActiveGainB, group.pBus);
+        return;
+    }
+    //Few audible channels so walk down each pair of them through the period rather than across every frame
+    int32_t* pBus = group.pBus;
+    memset(pBus, 0, 2 * nFrames * sizeof(int32_t));
+    for(int nIndex = group.nFirst; nIndex < group.nLast; nIndex += 2)
+    {
+        const unsigned char* pSample1 = pFrames + SAMPLESIZE * g_pActive[nIndex];
+        int16_t nGain1A = g_pActiveGainA[nIndex];
+        int16_t nGain1B = g_pActiveGainB[nIndex];
+        //Odd channel out is paired with silence
+        const unsigned char* pSample2 = pSample1;
+        int16_t nGain2A = 0;
+        int16_t nGain2B = 0;
+        if(nIndex + 1 < group.nLast)
+        {
+            pSample2 = pFrames + SAMPLESIZE * g_pActive[nIndex + 1];
+            nGain2A = g_pActiveGainA[nIndex + 1];
+            nGain2B = g_pActiveGainB[nIndex + 1];
+        }
+        for(int nFrame = 0; nFrame < nFrames; ++nFrame)
+        {
+            int nOffset = nFrame * g_nFrameSize;
+            int32_t nSample1 = (int16_t)(pSample1[nOffset] + (pSample1[nOffset + 1] << 8)); //get little endian sample into 16-bit word
+            int32_t nSample2 = (int16_t)(pSample2[nOffset] + (pSample2[nOffset + 1] << 8));
+            pBus[2 * nFrame] += (nSample1 * nGain1A + nSample2 * nGain2A) >> GAIN_SHIFT;
+            pBus[2 * nFrame + 1] += (nSample1 * nGain1B + nSample2 * nGain2B) >> GAIN_SHIFT;
+        }
+    }
+}
+
+void MixGroupFloat(MixGroup& group, const unsigned char* pFrames, int nFrames)
+{
+    if(!g_bCompact)
+    {
+        //Each group converts its own channels so conversion is shared between mix threads
+        g_pConvertKernel(pFrames, nFrames, g_nChannels, group.nFirst, group.nLast, g_pFloatFrames);
+        g_pFloatMixKernel(g_pFloatFrames, nFrames, g_nChannels, group.nFirst, group.nLast, g_pActiveFloatGainA, g_pActiveFloatGainB, group.pFloatBus);
+        if(g_bRamp)
+        {
+            g_pFloatMixKernel(g_pFloatFrames, nFrames, g_nChannels, group.nFirst, group.nLast, g_pRampFloatGainA, g_pRampFloatGainB, group.pFloatRampBus);
+            RampFloatBus(group.pFloatRampBus, group.pFloatBus, nFrames);
+        }
+        return;
+    }
+    //Few audible channels so convert and mix each of them down through the period
+    float* pBus = group.pFloatBus;
+    memset(pBus, 0, 2 * nFrames * sizeof(float));
+    for(int nIndex = group.nFirst; nIndex < group.nLast; ++nIndex)
+    {
+        const unsigned char* pSample = pFrames + SAMPLESIZE * g_pActive[nIndex];
+        float fGainA = g_pActiveFloatGainA[nIndex];
+        float fGainB = g_pActiveFloatGainB[nIndex];
+        for(int nFrame = 0; nFrame < nFrames; ++nFrame)
+        {
+            float fSample = ConvertSample(pSample + nFrame * g_nFrameSize);
+            pBus[2 * nFrame] += fSample * fGainA;
+            pBus[2 * nFrame + 1] += fSample * fGainB;
+        }
+    }
+}
+
+void MeterGroupTracks(const MixGroup& group, const unsigned char* pFrames, int nFrames)
+{
+    int nMetered = (nFrames + METER_DECIMATE - 1) / METER_DECIMATE;
+    if(!g_bCompact)
+    {
+        g_pMeterKernel(pFrames, nMetered, g_nFrameSize * METER_DECIMATE, group.nFirst, group.nLast, g_pMeterPeak, g_pMeterSquares);
+        return;
+    }
+    //Only audible channels are mixed so only they are metered
+    for(int nIndex = group.nFirst; nIndex < group.nLast; ++nIndex)
+        MeterScalar(pFrames, nMetered, g_nFrameSize * METER_DECIMATE, g_pActive[nIndex], g_pActive[nIndex] + 1, g_pMeterPeak, g_pMeterSquares);
+}
+
+void MeterOutput(const int16_t* pOutput, int nFrames)
+{
+    //Gather the same frames as were metered from tracks so that each vector of channels holds several stereo frames
+    int nMetered = (nFrames + METER_DECIMATE - 1) / METER_DECIMATE;
+    int nRows = (nMetered + METER_BUS_FRAMES - 1) / METER_BUS_FRAMES;
+    uint32_t pBusFrames[(PERIOD_SIZE / METER_DECIMATE + METER_BUS_FRAMES - 1) / METER_BUS_FRAMES * METER_BUS_FRAMES];
+    for(int nFrame = 0; nFrame < nMetered; ++nFrame)
+        memcpy(pBusFrames + nFrame, pOutput + 2 * METER_DECIMATE * nFrame, sizeof(uint32_t));
+    for(int nFrame = nMetered; nFrame < nRows * METER_BUS_FRAMES; ++nFrame)
+        pBusFrames[nFrame] = 0; //Silence adds nothing to readings
+    g_pMeterKernel((const unsigned char*)pBusFrames, nRows, 2 * SAMPLESIZE * METER_BUS_FRAMES, 0, 2 * METER_BUS_FRAMES, g_pBusPeak, g_pBusSquares);
+    g_nMeterFrames += nMetered;
+}
+
+void PublishMeters()
+{
+    MeterSnapshot& meters = g_meters.GetWriteBuffer();
+    float fScale = 1.0f / (FLOAT_SCALE * FLOAT_SCALE * max(1, g_nMeterFrames)); //Mean square relative to full scale
+    for(int nChan = 0; nChan < g_nChannels; ++nChan)
+    {
+        //Muted tracks are only metered whilst all tracks are mixed so always show them silent
+        bool bMuted = !g_pTargetGainA[nChan] && !g_pTargetGainB[nChan];
+        meters.pPeak[nChan] = bMuted ? 0 : g_pMeterPeak[nChan];
+        meters.pPower[nChan] = bMuted ? 0 : g_pMeterSquares[nChan] * fScale;
+    }
+    for(int nLeg = 0; nLeg < 2; ++nLeg)
+    {
+        meters.pBusPeak[nLeg] = 0;
+        meters.pBusPower[nLeg] = 0;
+        for(int nChan = nLeg; nChan < 2 * METER_BUS_FRAMES; nChan += 2)
+        {
+            meters.pBusPeak[nLeg] = max(meters.pBusPeak[nLeg], g_pBusPeak[nChan]);
+            meters.pBusPower[nLeg] += g_pBusSquares[nChan] * fScale;
+        }
+    }
+    meters.pInputPeak[0] = g_pInputPeak[0];
+    meters.pInputPeak[1] = g_pInputPeak[1];
+    g_meters.Publish();
+    ResetMeters();
+}
+
+void ResetMeters()
+{
+    memset(g_pMeterPeak, 0, sizeof(g_pMeterPeak));
+    memset(g_pMeterSquares, 0, sizeof(g_pMeterSquares));
+    memset(g_pBusPeak, 0, sizeof(g_pBusPeak));
+    memset(g_pBusSquares, 0, sizeof(g_pBusSquares));
+    memset(g_pInputPeak, 0, sizeof(g_pInputPeak));
+    g_nMeterFrames = 0;
+    g_nMeterPeriod = 0;
+}
+
+void Mixdown(const unsigned char* pFrames, int nFrames)
+{
+    if(g_bMixChanged)
+    {
+        //Gains or transport fade changed so ramp over this period - static gains cost nothing more
+        if(g_nFadeDir)
+            g_nFadePos = max(0, min(g_nFadeFrames, g_nFadePos + g_nFadeDir * nFrames));
+        RampMixer();
+    }
+    g_bMeterPeriod = (0 == g_nMeterPeriod % METER_INTERVAL); //Published to mix threads with period
+    if(g_nMixGroups > 1)
+    {
+        //Hand period to other mix threads, waking any that have gone to sleep
+        g_pMixFrames = pFrames;
+        g_nMixFrames = nFrames;
+        g_nMixPending.store(g_nMixGroups - 1, memory_order_relaxed);
+        g_nMixPeriod.fetch_add(1);
+        for(int nGroup = 1; nGroup < g_nMixGroups; ++nGroup)
+            if(g_aMixGroups[nGroup].bSleeping.exchange(false))
+                eventfd_write(g_aMixGroups[nGroup].fdWake, 1);
+    }
+    MixGroupTracks(g_aMixGroups[0], pFrames, nFrames);
+    //Wait for other groups then sum partial buses and saturate to output buffer in one pass
+    int nSpin = MIX_SPIN;
+    while(g_nMixPending.load(memory_order_acquire) > 0 && --nSpin > 0)
+        ;
+    if(g_nMixPending.load(memory_order_acquire) > 0)
+    {
+        //Mix thread has been held up, e.g. waiting for this core, so sleep until last mix thread finishes
+        g_bMixWaiting = true;
+        while(g_nMixPending.load() > 0)
+        {
+            pollfd pfd = {g_fdMixDone, POLLIN, 0};
+            poll(&pfd, 1, -1);
+            eventfd_t nValue;
+            eventfd_read(g_fdMixDone, &nValue);
+        }
+        g_bMixWaiting = false;
+    }
+    if(g_bFloat)
+        g_pFloatPackKernel(g_apFloatBuses, g_nMixGroups, 2 * nFrames, g_pPlayBuffer);
+    else
+        g_pPackKernel(g_apMixBuses, g_nMixGroups, 2 * nFrames, g_pPlayBuffer);
+    MonitorInput(g_pPlayBuffer); //Before metering so that output meter includes monitored input
+    if(g_bMeterPeriod)
+        MeterOutput(g_pPlayBuffer, nFrames);
+    if(++g_nMeterPeriod >= g_nMeterPeriods)
+        PublishMeters();
+}
+
+void MonitorInput(int16_t* pOutput)
+{
+    if(0 == g_nMonitorFrames)
+        return;
+    //Gains ramp over period from last period's to target faded by transport, like track gains, so that changes do not click
+    int nFade = FADE_UNITY;
+    if(g_nFadeFrames)
+        nFade = (int64_t)g_nFadePos * FADE_UNITY / g_nFadeFrames;
+    int pFrom[4] = {g_pMonitorA[0], g_pMonitorA[1], g_pMonitorB[0], g_pMonitorB[1]};
+    for(int nLeg = 0; nLeg < 2; ++nLeg)
+    {
+        g_pMonitorA[nLeg] = (g_pTargetMonitorA[nLeg] * nFade) >> 16;
+        g_pMonitorB[nLeg] = (g_pTargetMonitorB[nLeg] * nFade) >> 16;
+    }
+    int pTo[4] = {g_pMonitorA[0], g_pMonitorA[1], g_pMonitorB[0], g_pMonitorB[1]};
+    const unsigned char* pInput = g_pRecBuffer;
+    int nFrames = min(g_nMonitorFrames, PERIOD_SIZE);
+    //Step ramp position by RAMP_UNITY / nFrames with carry like RampBus so that gains reach target on last frame without dividing each frame
+    int nStep = RAMP_UNITY / nFrames;
+    int nRemainder = RAMP_UNITY % nFrames;
+    int nPos = 0;
+    int nCarry = 0;
+    for(int nFrame = 0; nFrame < nFrames; ++nFrame)
+    {
+        nPos += nStep;
+        nCarry += nRemainder;
+        if(nCarry >= nFrames)
+        {
+            ++nPos;
+            nCarry -= nFrames;
+        }
+        int pGain[4];
+        for(int i = 0; i < 4; ++i)
+            pGain[i] = pFrom[i] + (pTo[i] - pFrom[i]) * nPos / RAMP_UNITY;
+        int nInA = (int16_t)(pInput[4 * nFrame] + (pInput[4 * nFrame + 1] << 8)); //get little endian sample into 16-bit word
+        int nInB = (int16_t)(pInput[4 * nFrame + 2] + (pInput[4 * nFrame + 3] << 8));
+        int nOutA = pOutput[2 * nFrame] + ((nInA * pGain[0] + nInB * pGain[1]) >> GAIN_SHIFT);
+        int nOutB = pOutput[2 * nFrame + 1] + ((nInA * pGain[2] + nInB * pGain[3]) >> GAIN_SHIFT);
+        pOutput[2 * nFrame] = max(-32768, min(32767, nOutA));
+        pOutput[2 * nFrame + 1] = max(-32768, min(32767, nOutB));
+    }
+    g_nMonitorFrames = 0;
+}
+
+void WriterFlush()
+{
+    g_bWriteFlush = true;
+    eventfd_write(g_fdWriteWake, 1);
+}
+
+void WriterWait()
+{
+    while(g_ringWrite.GetReadSpace() && g_bWriterRunning)
+    {
+        WriterFlush();
+        usleep(1000);
+    }
+}
+
+void Writer()
+{
+    if(g_bRealtime)
+        StartRealtime(false);
+    while(g_bWriterRunning || g_ringWrite.GetReadSpace())
+    {
+        int nBlocks = g_ringWrite.GetReadSpace();
+        if(0 == nBlocks || (nBlocks < g_nWriteChunk && !g_bWriteFlush && g_bWriterRunning))
+        {
+            //Wait until enough recorded audio to write or flush requested
+            if(0 == nBlocks)
+                g_bWriteFlush = false;
+            if(0 == nBlocks && TC_STOP == g_nTransport)
+                TrimFile(); //Stopped and all recorded audio written
+            pollfd pfd = {g_fdWriteWake, POLLIN, 0};
+            eventfd_t nValue;
+            if(poll(&pfd, 1, PREFETCH_TIMEOUT) > 0)
+                eventfd_read(g_fdWriteWake, &nValue);
+            continue;
+        }
+        //Coalesce blocks that are contiguous in memory and in file in to a single write
+        int nSize = 0;
+        int64_t nTag = 0;
+        const unsigned char* pData = g_ringWrite.GetReadPointer(&nSize, &nTag);
+        int nContiguous = g_ringWrite.GetReadSpace(true);
+        int nCount = 1;
+        size_t nBytes = nSize;
+        while(nCount < nContiguous && nSize == g_nPeriodSize && nBytes < (size_t)WRITE_CHUNK)
+        {
+            int64_t nNextTag = 0;
+            g_ringWrite.GetReadPointer(&nSize, &nNextTag, nCount);
+            if(nNextTag != nTag + (int64_t)(nBytes / g_nFrameSize))
+                break; //Not contiguous or armed tracks changed
+            nBytes += nSize;
+            ++nCount;
+        }
+        off_t offWrite = g_offStartOfData + (nTag & TAG_POS_MASK) * g_nFrameSize;
+        int64_t nStart = GetMicroseconds();
+        bool bWritten;
+        if(g_bPlanar)
+            bWritten = WriteTracks(pData, nBytes, nTag);
+        else
+        {
+            if(offWrite + (off_t)nBytes > g_offAllocated)
+            {
+                UpdateHeader(); //Keep header up to date with each extent so that file is readable if not closed cleanly
+                ExtendFile(g_fdWave, g_offEndOfData, offWrite + nBytes, g_offAllocated);
+            }
+            bWritten = (pwrite(g_fdWave, pData, nBytes, offWrite) == (ssize_t)nBytes);
+        }
+        g_aTiming[PHASE_DISK].Add(GetMicroseconds() - nStart, (int64_t)nBytes / g_nFrameSize * 1000000 / g_nSamplerate); //Must write faster than real-time
+        if(!bWritten)
+            cerr << "Failed to write recording to file" << endl;
+        else if(offWrite + (off_t)nBytes > g_offEndOfData)
+            g_offEndOfData = offWrite + nBytes;
+        g_ringWrite.Release(nCount);
+    }
+}
+
+void ExtendFile(int fd, off_t offEnd, off_t offNeeded, off_t& offAllocated)
+{
+    //Each write beyond end of file would allocate a little more space, fragmenting file and updating its metadata every write
+    off_t offFrom = max(offAllocated, offEnd);
+    off_t nLength = (offNeeded - offFrom + FILE_EXTENT - 1) / FILE_EXTENT * FILE_EXTENT;
+    if(0 == fallocate(fd, FALLOC_FL_KEEP_SIZE, offFrom, nLength))
+        offAllocated = offFrom + nLength; //Space allocated beyond end of file so file length stays at end of data
+    else if(EOPNOTSUPP == errno && 0 == ftruncate(fd, offFrom + nLength))
+        offAllocated = offFrom + nLength; //Filesystem cannot allocate so extend file (sparse where supported) and trim to end of data when stopped
+    else
+        cerr << "Failed to allocate file space for recording - error " << errno << endl; //Write is still attempted in case it fits
+}
+
+void TrimFile()
+{
+    if(g_fdWave > 0)
+        TrimFile(g_fdWave, g_offEndOfData, g_offAllocated);
+    for(int nTrack = 0; nTrack < MAX_CHANNELS; ++nTrack)
+        if(g_afdTrack[nTrack] >= 0)
+            TrimFile(g_afdTrack[nTrack], g_aoffTrackEnd[nTrack], g_aoffTrackAllocated[nTrack]);
+}
+
+void TrimFile(int fd, off_t offEnd, off_t& offAllocated)
+{
+    //Truncate to end of data, releasing space allocated beyond it
+    if(offAllocated <= offEnd)
+        return;
+    ftruncate(fd, offEnd);
+    offAllocated = offEnd;
+}
+
+void HandleCommands()
+{
+    EngineCommand command;
+    while(g_queueCommands.Pop(command))
+    {
+        switch(command.nCommand)
+        {
+            case CMD_START:
+                if(TC_PLAY == g_nTransport && g_nFadeDir < 0)
+                {
+                    StartFade(1); //Restarted whilst fading out so fade back in
+                    break;
+                }
+                //Currently stopped so need to open interfaces and start
+                if(TC_STOP != g_nTransport || !OpenReplay())
+                    break;
+                if(g_nFadeFrames)
+                    StartFade(1);
+                if(!g_pPcmRecord)
+                    OpenRecord(); //Replay without recording if record device is unavailable
+                g_nTransport = TC_PLAY;
+                //!@todo Configure whether auto return to zero when playing from end of track
+                if(!g_bRecordEnabled && g_lHeadPos >= g_nLastFrame)
+                    g_lHeadPos = 0;
+                if(g_lHeadPos == g_lPrefetchNext)
+                    ResetRecordPosition(); //Read-ahead already holds audio from play head
+                else
+                    SetPlayHead(g_lHeadPos);
+                g_nStartRequested = command.nQueued;
+                StartDuplex();
+                break;
+            case CMD_STOP:
+                //Currently playing so need to stop
+                if(TC_PLAY != g_nTransport)
+                    break;
+                if(g_nFadeFrames)
+                    StartFade(-1); //Play stops when faded out
+                else
+                    StopTransport();
+                break;
+            case CMD_LOCATE:
+                SetPlayHead(command.lValue);
+                break;
+            case CMD_RECORD_ENABLE:
+                if(!command.lValue)
+                    WriterFlush();
+                else if(!g_bRecordEnabled)
+                    ResetRecordPosition();
+                g_bRecordEnabled = command.lValue;
+                break;
+            case CMD_ARM_A:
+                g_nRecA = command.lValue;
+                WriterFlush();
+                break;
+            case CMD_ARM_B:
+                g_nRecB = command.lValue;
+                WriterFlush();
+                break;
+        }
+        UpdateMixer();
+        PrefetchReread();
+        eventfd_write(g_fdUiWake, 1); //Update display
+    }
+}
+
+void StopTransport()
+{
+    if(g_pPcmPlay)
+        StopDuplex();
+    g_nTransport = TC_STOP;
+    g_bRecordEnabled = false;
+    g_nStartRequested = 0;
+    g_nFadeDir = 0;
+    UpdateMixer();
+    WriterFlush();
+    eventfd_write(g_fdUiWake, 1);
+}
+
+void Engine()
+{
+    if(g_bRealtime)
+        StartRealtime(true);
+    if(g_bFloat)
+        SetFlushToZero(true);
+    //Keep audio devices open and prepared whilst stopped so that transport starts without reconfiguring them
+    if(OpenReplay())
+        OpenRecord();
+    pollfd aFds[MAX_POLL_FDS];
+    while(g_bEngineRunning)
+    {
+        HandleCommands();
+
+        //Wait for a command or for audio devices to be ready
+        aFds[0].fd = g_fdEngineWake;
+        aFds[0].events = POLLIN;
+        int nFds = 1;
+        int nPlayFds = 0;
+        int nRecordFds = 0;
+        bool bDuplex = g_bMonitor && g_pPcmRecord && g_pPcmPlay; //Capture paces replay so that monitored input is replayed in the cycle it is captured
+        if(g_pPcmPlay && TC_PLAY == g_nTransport && !bDuplex)
+        {
+            nPlayFds = snd_pcm_poll_descriptors(g_pPcmPlay, aFds + nFds, MAX_POLL_FDS - nFds);
+            nFds += nPlayFds;
+        }
+        if(g_pPcmRecord && TC_PLAY == g_nTransport)
+        {
+            nRecordFds = snd_pcm_poll_descriptors(g_pPcmRecord, aFds + nFds, MAX_POLL_FDS - nFds);
+            nFds += nRecordFds;
+        }
+        if(poll(aFds, nFds, -1) < 0)
+            continue;
+        int64_t nWake = GetMicroseconds();
+        memset(g_aCycleTime, 0, sizeof(g_aCycleTime));
+        if(aFds[0].revents)
+        {
+            eventfd_t nValue;
+            eventfd_read(g_fdEngineWake, &nValue);
+        }
+        unsigned short nEvents;
+        bool bAudio = false; //True if audio devices were serviced
+        if(nRecordFds && 0 == snd_pcm_poll_descriptors_revents(g_pPcmRecord, aFds + 1 + nPlayFds, nRecordFds, &nEvents) && nEvents)
+        {
+            bAudio = true;
+            int64_t nStart = GetMicroseconds();
+            bool bRecord = Record();
+            AddTiming(PHASE_CAPTURE, nStart);
+            if(!bRecord)
+                CloseRecord();
+        }
+        bool bReplay = bDuplex ? (g_nMonitorFrames > 0) : (nPlayFds && 0 == snd_pcm_poll_descriptors_revents(g_pPcmPlay, aFds + 1, nPlayFds, &nEvents) && nEvents);
+        if(bReplay)
+        {
+            bAudio = true;
+            if(!Play())
+                StopTransport(); //Reached end of file
+        }
+        if(bAudio)
+            CheckDeadline(nWake);
+    }
+    CloseReplay();
+    CloseRecord();
+}
+
+void StartEngine()
+{
+    //Audio runs in its own thread so that user interface cannot delay it
+    //Disk reads run in their own thread so that storage cannot delay audio
+    //High track counts are mixed by a pool of threads, one per core
+    StartMixers();
+    g_bWriterRunning = true;
+    g_threadWriter = thread(Writer);
+    g_bPrefetchRunning = true;
+    g_threadPrefetch = thread(Prefetch);
+    g_bEngineRunning = true;
+    g_threadEngine = thread(Engine);
+}
+
+void StopEngine()
+{
+    g_bEngineRunning = false;
+    eventfd_write(g_fdEngineWake, 1);
+    g_threadEngine.join();
+    StopMixers();
+    g_bPrefetchRunning = false;
+    PrefetchWake();
+    g_threadPrefetch.join();
+    g_bWriterRunning = false; //Writer finishes queued writes before exiting
+    WriterFlush();
+    g_threadWriter.join();
+}
+
+int64_t AddTiming(int nPhase, int64_t nStart)
+{
+    int64_t nNow = GetMicroseconds();
+    g_aTiming[nPhase].Add(nNow - nStart, g_nPeriodTime);
+    g_aCycleTime[nPhase] += nNow - nStart;
+    return nNow;
+}
+
+void CheckDeadline(int64_t nWake)
+{
+    //Watchdog - audio thread must finish each wake-up within one period to keep up with audio devices
+    int64_t nCycle = GetMicroseconds() - nWake;
+    g_aTiming[PHASE_CYCLE].Add(nCycle, g_nPeriodTime);
+    if(nCycle <= g_nPeriodTime)
+        return;
+    int nSlowest = PHASE_READ;
+    for(int nPhase = PHASE_READ; nPhase < PHASE_CYCLE; ++nPhase)
+        if(g_aCycleTime[nPhase] > g_aCycleTime[nSlowest])
+            nSlowest = nPhase;
+    g_aTiming[nSlowest].Blame();
+    g_aTiming[PHASE_CYCLE].Blame();
+}
+
+/** Touch the calling thread's stack so that it is resident (not inlined so that the buffer is really on the stack) */
+static void __attribute__((noinline)) PrefaultStack()
+{
+    volatile unsigned char pStack[RT_STACK_PREFAULT];
+    for(int nOffset = 0; nOffset < RT_STACK_PREFAULT; nOffset += sysconf(_SC_PAGESIZE))
+        pStack[nOffset] = 0;
+    (void)pStack[0];
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/** Set or clear flush to zero (FTZ) and denormals are zero (DAZ) in SSE control register */
+static __attribute__((target("sse2"))) void SetFlushToZeroSse2(bool bEnable)
+{
+    if(bEnable)
+        _mm_setcsr(_mm_getcsr() | 0x8040); //FTZ is bit 15, DAZ is bit 6
+    else
+        _mm_setcsr(_mm_getcsr() & ~0x8040);
+}
+#endif //x86
+
+void SetFlushToZero(bool bEnable)
+{
+    //Denormal floats (e.g. decaying tails) take many times longer to process on most CPUs and are inaudible
+#if defined(__x86_64__) || defined(__i386__)
+    if(__builtin_cpu_supports("sse2"))
+        SetFlushToZeroSse2(bEnable);
+#elif defined(__aarch64__)
+    uint64_t nFpcr;
+    asm volatile("mrs %0, fpcr" : "=r"(nFpcr));
+    nFpcr = bEnable ? (nFpcr | (1 << 24)) : (nFpcr & ~(1 << 24)); //FZ
+    asm volatile("msr fpcr, %0" : : "r"(nFpcr));
+#elif defined(__ARM_FP)
+    uint32_t nFpscr;
+    asm volatile("vmrs %0, fpscr" : "=r"(nFpscr));
+    nFpscr = bEnable ? (nFpscr | (1 << 24)) : (nFpscr & ~(1 << 24)); //FZ (NEON always flushes)
+    asm volatile("vmsr fpscr, %0" : : "r"(nFpscr));
+#endif
+}
+
+void StartRealtime(bool bAudio)
+{
+    PrefaultStack();
+    if(!bAudio)
+        return;
+    sched_param param;
+    param.sched_priority = g_nRtPriority;
+    g_nRtError = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+}
+
+/** Get CPU time used by a thread
+*   @param  thread Thread handle
+*   @return <i>double</i> CPU time in seconds
+*/
+static double GetThreadCpu(pthread_t thread)
+{
+    clockid_t clock;
+    timespec ts;
+    if(pthread_getcpuclockid(thread, &clock) || clock_gettime(clock, &ts))
+        return 0;
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/** Get quantity of times calling thread has been scheduled out */
+static long GetThreadSwitches()
 {
-    if(g_fdWave <= 0)
-        return;
-    //Use minimal RIFF header - write new header, move wave data then truncate file
-    char pHeader[36];
-    strncpy(pHeader, "RIFF", 4);
-    SetLE32(pHeader + 4, nWaveSize + 36); //size of RIFF chunck
-    strncpy(pHeader + 8, "WAVE", 4);
-    strncpy(pHeader + 12, "fmt ", 4); //start of format chunk
-    SetLE32(pHeader + 16, 16); //size of format chunck
-    SetLE16(pHeader + 20, 1); //Audio format = PCM
-    SetLE16(pHeader + 22, g_nChannels); //Number of channesl
-    SetLE32(pHeader + 24, g_nSamplerate);
-    SetLE32(pHeader + 28, g_nSamplerate * g_nChannels * SAMPLESIZE); //Sample rate
-    SetLE16(pHeader + 32, g_nChannels * SAMPLESIZE); //Block align == frame size
-    SetLE16(pHeader + 34, SAMPLESIZE * 8); //Bits per sample
-    pwrite(g_fdWave, pHeader, sizeof(pHeader), 0);
-    strncpy(pHeader, "data", 4);
-    SetLE32(pHeader + 4, nWaveSize);
-    pwrite(g_fdWave, pHeader, 8, 36);
+    rusage usage;
+    if(getrusage(RUSAGE_THREAD, &usage))
+        return 0;
+    return usage.ru_nvcsw + usage.ru_nivcsw;
 }
 
-//Closes WAVE file
-void CloseFile()
+/** Set gain of a channel to both outputs without ramping */
+static void BenchSetGain(int nChannel, int16_t nGain)
 {
-    if(g_fdWave > 0)
-    {
-        //Write RIFF chunck length
-        char pBuffer[4];
-        SetLE32(pBuffer, g_offEndOfData - 8);
-        pwrite(g_fdWave, pBuffer, 4, 4);
-        close(g_fdWave);
-    }
-    g_fdWave = -1;
-    g_nTransport = TC_STOP;
-    g_nChannels = 0;
+    g_pTargetGainA[nChannel] = g_pGainA[nChannel] = nGain;
+    g_pTargetGainB[nChannel] = g_pGainB[nChannel] = nGain;
+    g_pTargetFloatGainA[nChannel] = g_pFloatGainA[nChannel] = (float)nGain / GAIN_UNITY;
+    g_pTargetFloatGainB[nChannel] = g_pFloatGainB[nChannel] = (float)nGain / GAIN_UNITY;
+    g_bMixChanged = false;
 }
 
-void SetPlayHead(int nPosition)
+/** Measure CPU used by audio thread whilst stopped */
+static void BenchIdle()
 {
-    g_lHeadPos = nPosition;
-    if(g_lHeadPos < 0)
-        g_lHeadPos = 0;
-    if(g_lHeadPos > g_nLastFrame)
-        g_lHeadPos = g_nLastFrame;
-    if(g_fdWave > 0)
-        lseek(g_fdWave, g_offStartOfData + g_lHeadPos * g_nFrameSize, SEEK_SET);
-    ShowHeadPosition();
+    cout << "Idle audio thread (" << BENCH_IDLE_SECONDS << "s each):" << endl;
+    //Previous implementation slept 1ms between checks for work
+    atomic<bool> bRun(true);
+    long lWakes = 0;
+    thread threadSleep([&]() { while(bRun) usleep(1000); lWakes = GetThreadSwitches(); });
+    sleep(BENCH_IDLE_SECONDS);
+    double dCpu = GetThreadCpu(threadSleep.native_handle());
+    bRun = false;
+    threadSleep.join();
+    printf("  sleep 1ms loop:  %6.0f wakeups/s %6.3f%% CPU\n", (double)lWakes / BENCH_IDLE_SECONDS, 100 * dCpu / BENCH_IDLE_SECONDS);
+    //Audio thread now blocks until commanded
+    g_bEngineRunning = true;
+    thread threadEngine([&]() { Engine(); lWakes = GetThreadSwitches(); });
+    sleep(BENCH_IDLE_SECONDS);
+    dCpu = GetThreadCpu(threadEngine.native_handle());
+    g_bEngineRunning = false;
+    eventfd_write(g_fdEngineWake, 1);
+    threadEngine.join();
+    printf("  poll event loop: %6.0f wakeups/s %6.3f%% CPU\n", (double)lWakes / BENCH_IDLE_SECONDS, 100 * dCpu / BENCH_IDLE_SECONDS);
 }
 
-//Open replay device
-bool OpenReplay()
+/** Queue a period of silence and start replay and record devices
+*   @return <i>bool</i> True on success
+*/
+static bool BenchStartDevices()
 {
-    int nError;
-    if(g_pPcmPlay)
-        return true;
+    if(g_pPcmRecord && !g_bLinked)
+        g_bLinked = (0 == snd_pcm_link(g_pPcmPlay, g_pPcmRecord));
+    if(snd_pcm_writei(g_pPcmPlay, g_pPlayBuffer, PERIOD_SIZE) != PERIOD_SIZE)
+        return false;
+    snd_pcm_start(g_pPcmPlay);
+    if(g_pPcmRecord && !g_bLinked)
+        snd_pcm_start(g_pPcmRecord);
+    return true;
+}
 
-    //**Open sound device**
-    if((nError = snd_pcm_open(&g_pPcmPlay, g_sPcmPlayName.c_str(), SND_PCM_STREAM_PLAYBACK, 0)) != 0)
+/** Measure time from transport start request until first audio reaches replay device */
+static void BenchStart()
+{
+    cout << "Transport start latency (" << BENCH_STARTS << " starts each):" << endl;
+    memset(g_pPlayBuffer, 0, sizeof(g_pPlayBuffer));
+    //Previous implementation opened and configured devices on each start
+    int64_t nTotal = 0;
+    int64_t nMax = 0;
+    for(int nStart = 0; nStart < BENCH_STARTS; ++nStart)
     {
-        cerr << "Unable to open replay device: " << snd_strerror(nError) << endl;
+        int64_t nRequest = GetMicroseconds();
+        if(!OpenReplay())
+        {
+            cout << "  No replay device available" << endl;
+            return;
+        }
+        OpenRecord();
+        if(!BenchStartDevices())
+            break;
+        int64_t nLatency = GetMicroseconds() - nRequest;
+        nTotal += nLatency;
+        nMax = max(nMax, nLatency);
+        usleep(BENCH_ROLL * 1000);
         CloseReplay();
-        return false;
+        CloseRecord();
     }
-    if((nError = snd_pcm_set_params(g_pPcmPlay,
-                                  SND_PCM_FORMAT_S16_LE, //!@todo does this depend on WAVE file format?
-                                  SND_PCM_ACCESS_RW_INTERLEAVED,
-                                  2, //2 channels (left & right)
-                                  g_nSamplerate,
-                                  0, //Don't resample
-                                  REPLAY_LATENCY)) != 0)
+    printf("  reopen devices:   %7.2fms mean %7.2fms max\n", nTotal / 1000.0 / BENCH_STARTS, nMax / 1000.0);
+    //Devices now stay open and prepared whilst stopped
+    nTotal = 0;
+    nMax = 0;
+    OpenReplay();
+    OpenRecord();
+    for(int nStart = 0; nStart < BENCH_STARTS; ++nStart)
     {
-        cerr << "Unable to configure replay device: " << snd_strerror(nError) << endl;
-        CloseReplay();
-        return false;
+        int64_t nRequest = GetMicroseconds();
+        if(!BenchStartDevices())
+            break;
+        int64_t nLatency = GetMicroseconds() - nRequest;
+        nTotal += nLatency;
+        nMax = max(nMax, nLatency);
+        usleep(BENCH_ROLL * 1000);
+        StopDuplex();
     }
-
-	return true;
+    printf("  prepared devices: %7.2fms mean %7.2fms max\n", nTotal / 1000.0 / BENCH_STARTS, nMax / 1000.0);
+    CloseReplay();
+    CloseRecord();
 }
 
-//Close replay device
-void CloseReplay()
+/** Measure mixdown throughput with increasing quantity of mix threads */
+static void BenchMix()
 {
-    if(g_pPcmPlay)
-        snd_pcm_close(g_pPcmPlay);
-    g_pPcmPlay = NULL;
-    if(!g_bRecordEnabled)
-        g_nTransport = TC_STOP;
-    ShowMenu();
+    cout << "Mixdown of " << BENCH_MIX_TRACKS << " tracks at " << BENCH_MIX_RATE << "Hz (" << BENCH_MIX_PERIODS << " periods each):" << endl;
+    g_nChannels = BENCH_MIX_TRACKS;
+    g_nFrameSize = g_nChannels * SAMPLESIZE;
+    unsigned char* pFrames = new unsigned char[g_nFrameSize * PERIOD_SIZE];
+    for(int i = 0; i < g_nFrameSize * PERIOD_SIZE; ++i)
+        pFrames[i] = rand();
+    for(int i = 0; i < g_nChannels; ++i)
+        BenchSetGain(i, LevelTable::aLevel[4 * LEVEL_STEPS_6DB]);
+    CompactMixer();
+    int nCores = max(1, min((int)thread::hardware_concurrency(), MAX_MIX_THREADS));
+    double dSingle = 0;
+    for(int nThreads = 1; nThreads <= nCores; ++nThreads)
+    {
+        g_nMixThreads = nThreads;
+        StartMixers();
+        int64_t nStart = GetMicroseconds();
+        for(int nPeriod = 0; nPeriod < BENCH_MIX_PERIODS; ++nPeriod)
+            Mixdown(pFrames, PERIOD_SIZE);
+        double dSeconds = (GetMicroseconds() - nStart) / 1e6;
+        StopMixers();
+        double dPeriods = BENCH_MIX_PERIODS / dSeconds;
+        if(1 == nThreads)
+            dSingle = dPeriods;
+        printf("  %d core%s (%d groups): %9.0f periods/s %7.1fx real-time %5.2fx speedup\n", nThreads, 1 == nThreads ? " " : "s", g_nMixGroups,
+            dPeriods, dPeriods * PERIOD_SIZE / BENCH_MIX_RATE, dPeriods / dSingle);
+    }
+    delete[] pFrames;
+    g_nMixThreads = 0;
 }
 
-//Open record device
-bool OpenRecord()
+/** Mix by shifting each sample in 6dB steps, as before gain tables, for comparison with mix kernels
+*   @param  pShiftA Attenuation (x 6dB) of each channel to A-leg (16 = -Inf)
+*   @param  pShiftB Attenuation (x 6dB) of each channel to B-leg (16 = -Inf)
+*/
+static void BenchMixShift(const unsigned char* pFrames, int nFrames, int nFrameSize, int nChannels, const int* pShiftA, const int* pShiftB, int32_t* pBus)
 {
-    if(g_pPcmRecord)
-        return true; //Already open
+    for(int nFrame = 0; nFrame < nFrames; ++nFrame)
+    {
+        const unsigned char* pFrame = pFrames + nFrame * nFrameSize;
+        int32_t nMixA = 0;
+        int32_t nMixB = 0;
+        for(int nChan = 0; nChan < nChannels; ++nChan)
+        {
+            int16_t nSample = pFrame[SAMPLESIZE * nChan] + (pFrame[SAMPLESIZE * nChan + 1] << 8);
+            if(16 != pShiftA[nChan])
+                nMixA += nSample >> pShiftA[nChan];
+            if(16 != pShiftB[nChan])
+                nMixB += nSample >> pShiftB[nChan];
+        }
+        pBus[2 * nFrame] = nMixA;
+        pBus[2 * nFrame + 1] = nMixB;
+    }
+}
 
-    //**Open sound device**
-    int nError;
-    if((nError = snd_pcm_open(&g_pPcmRecord, g_sPcmRecName.c_str(), SND_PCM_STREAM_CAPTURE, 0)) != 0)
+/** Measure speed of each mix kernel supported by this CPU against scalar kernel and 6dB shift mix */
+static void BenchKernels()
+{
+    cout << "Mix kernels, " << BENCH_KERNEL_TRACKS << " tracks mixed and saturated to 16-bit (" << BENCH_KERNEL_PERIODS << " periods each):" << endl;
+    int nFrameSize = BENCH_KERNEL_TRACKS * SAMPLESIZE;
+    unsigned char* pFrames = new unsigned char[nFrameSize * PERIOD_SIZE];
+    for(int i = 0; i < nFrameSize * PERIOD_SIZE; ++i)
+        pFrames[i] = rand();
+    alignas(16) int16_t pGainA[MAX_CHANNELS];
+    alignas(16) int16_t pGainB[MAX_CHANNELS];
+    for(int i = 0; i < MAX_CHANNELS; ++i)
     {
-        cerr << "Unable to open record device: " << snd_strerror(nError) << endl;
-        CloseRecord();
-        return false;
+        pGainA[i] = rand() % GAIN_UNITY;
+        pGainB[i] = rand() % GAIN_UNITY;
     }
-    if((nError = snd_pcm_set_params(g_pPcmRecord,
-                                  SND_PCM_FORMAT_S16_LE, //!@todo does this depend on WAVE file format?
-                                  SND_PCM_ACCESS_RW_INTERLEAVED,
-                                  2, //2 channels (left & right)
-                                  g_nSamplerate,
-                                  0, //Don't resample
-                                  RECORD_LATENCY)) != 0)
+    alignas(64) int32_t pBus[PERIOD_SIZE * 2];
+    const int32_t* ppBuses[1] = {pBus};
+    int pShiftA[MAX_CHANNELS];
+    int pShiftB[MAX_CHANNELS];
+    for(int i = 0; i < MAX_CHANNELS; ++i)
     {
-        cerr << "Unable to configure record device: " << snd_strerror(nError) << endl;
-        CloseRecord();
-        return false;
+        pShiftA[i] = rand() % 17;
+        pShiftB[i] = rand() % 17;
     }
-
-    if(g_nRecA > -1)
-        g_track[g_nRecA].bRecording = true;
-    if(g_nRecB > -1)
-        g_track[g_nRecB].bRecording = true;
-
-	return true;
+    int16_t pReference[PERIOD_SIZE * 2];
+    int16_t pOutput[PERIOD_SIZE * 2];
+    MixScalar<0>(pFrames, PERIOD_SIZE, nFrameSize, 0, BENCH_KERNEL_TRACKS, pGainA, pGainB, pBus);
+    PackScalar(ppBuses, 1, PERIOD_SIZE * 2, pReference);
+    int16_t pShifted[PERIOD_SIZE * 2];
+    int64_t nStart = GetMicroseconds();
+    for(int nPeriod = 0; nPeriod < BENCH_KERNEL_PERIODS; ++nPeriod)
+    {
+        BenchMixShift(pFrames, PERIOD_SIZE, nFrameSize, BENCH_KERNEL_TRACKS, pShiftA, pShiftB, pBus);
+        PackScalar(ppBuses, 1, PERIOD_SIZE * 2, pShifted);
+    }
+    double dShift = (GetMicroseconds() - nStart) * 1000.0 / BENCH_KERNEL_PERIODS;
+    printf("  %-7s %8.0fns/period (6dB steps by shifting each sample)\n", "shift", dShift);
+    double dScalar = 0;
+    for(int nKernel = 0; nKernel < MIX_KERNELS; ++nKernel)
+    {
+        const MixKernelInfo& kernel = g_aMixKernels[nKernel];
+        if(!kernel.bSupported)
+        {
+            printf("  %-7s not supported by this CPU\n", kernel.sName);
+            continue;
+        }
+        nStart = GetMicroseconds();
+        for(int nPeriod = 0; nPeriod < BENCH_KERNEL_PERIODS; ++nPeriod)
+        {
+            kernel.pKernel(pFrames, PERIOD_SIZE, nFrameSize, 0, BENCH_KERNEL_TRACKS, pGainA, pGainB, pBus);
+            kernel.pPack(ppBuses, 1, PERIOD_SIZE * 2, pOutput);
+        }
+        double dNanoseconds = (GetMicroseconds() - nStart) * 1000.0 / BENCH_KERNEL_PERIODS;
+        if(0 == nKernel)
+            dScalar = dNanoseconds;
+        bool bMatch = (0 == memcmp(pOutput, pReference, sizeof(pOutput)));
+        printf("  %-7s %8.0fns/period %6.2fx scalar %6.2fx shift %s\n", kernel.sName, dNanoseconds, dScalar / dNanoseconds, dShift / dNanoseconds, bMatch ? "" : "OUTPUT DIFFERS FROM SCALAR");
+    }
+    delete[] pFrames;
 }
 
-//Close record device
-void CloseRecord()
+/** Compare float mix (conversion, mix and conversion to 16-bit) with integer mix for each instruction set then show cost of denormals */
+static void BenchFloat()
 {
-    if(g_pPcmRecord)
-        snd_pcm_close(g_pPcmRecord);
-    g_pPcmRecord = NULL;
-    if(g_nRecA > -1)
-        g_track[g_nRecA].bRecording = false;
-    if(g_nRecB > -1)
-        g_track[g_nRecB].bRecording = false;
+    cout << "Float mix, " << BENCH_KERNEL_TRACKS << " tracks converted, mixed and converted to 16-bit (" << BENCH_KERNEL_PERIODS << " periods each):" << endl;
+    int nFrameSize = BENCH_KERNEL_TRACKS * SAMPLESIZE;
+    unsigned char* pFrames = new unsigned char[nFrameSize * PERIOD_SIZE];
+    for(int i = 0; i < nFrameSize * PERIOD_SIZE; ++i)
+        pFrames[i] = rand();
+    alignas(16) int16_t pGainA[MAX_CHANNELS];
+    alignas(16) int16_t pGainB[MAX_CHANNELS];
+    alignas(32) float pFloatGainA[MAX_CHANNELS];
+    alignas(32) float pFloatGainB[MAX_CHANNELS];
+    for(int i = 0; i < MAX_CHANNELS; ++i)
+    {
+        pGainA[i] = rand() % (GAIN_UNITY / 4); //Mix of random tracks rarely clips below -12dB
+        pGainB[i] = rand() % (GAIN_UNITY / 4);
+        pFloatGainA[i] = pGainA[i] / (float)GAIN_UNITY;
+        pFloatGainB[i] = pGainB[i] / (float)GAIN_UNITY;
+    }
+    alignas(64) int32_t pBus[PERIOD_SIZE * 2];
+    alignas(64) float pFloatBus[PERIOD_SIZE * 2];
+    const int32_t* ppBuses[1] = {pBus};
+    const float* ppFloatBuses[1] = {pFloatBus};
+    int16_t pReference[PERIOD_SIZE * 2];
+    int16_t pOutput[PERIOD_SIZE * 2];
+    MixScalar<0>(pFrames, PERIOD_SIZE, nFrameSize, 0, BENCH_KERNEL_TRACKS, pGainA, pGainB, pBus);
+    PackScalar(ppBuses, 1, PERIOD_SIZE * 2, pReference);
+    SetFlushToZero(true);
+    for(int nKernel = 0; nKernel < MIX_KERNELS; ++nKernel)
+    {
+        const MixKernelInfo& kernel = g_aMixKernels[nKernel];
+        if(!kernel.bSupported)
+            continue;
+        int64_t nStart = GetMicroseconds();
+        for(int nPeriod = 0; nPeriod < BENCH_KERNEL_PERIODS; ++nPeriod)
+        {
+            kernel.pKernel(pFrames, PERIOD_SIZE, nFrameSize, 0, BENCH_KERNEL_TRACKS, pGainA, pGainB, pBus);
+            kernel.pPack(ppBuses, 1, PERIOD_SIZE * 2, pOutput);
+        }
+        double dInteger = (GetMicroseconds() - nStart) * 1000.0 / BENCH_KERNEL_PERIODS;
+        nStart = GetMicroseconds();
+        for(int nPeriod = 0; nPeriod < BENCH_KERNEL_PERIODS; ++nPeriod)
+        {
+            kernel.pConvert(pFrames, PERIOD_SIZE, BENCH_KERNEL_TRACKS, 0, BENCH_KERNEL_TRACKS, g_pFloatFrames);
+            kernel.pFloatMix(g_pFloatFrames, PERIOD_SIZE, BENCH_KERNEL_TRACKS, 0, BENCH_KERNEL_TRACKS, pFloatGainA, pFloatGainB, pFloatBus);
+            kernel.pFloatPack(ppFloatBuses, 1, PERIOD_SIZE * 2, pOutput);
+        }
+        double dFloat = (GetMicroseconds() - nStart) * 1000.0 / BENCH_KERNEL_PERIODS;
+        //Integer mix truncates each pair of products so expect float to differ by a few LSB
+        int nError = 0;
+        for(int i = 0; i < PERIOD_SIZE * 2; ++i)
+            nError = max(nError, abs(pOutput[i] - pReference[i]));
+        printf("  %-7s %8.0fns integer %8.0fns float %6.2fx integer  max %d LSB from integer\n", kernel.sName, dInteger, dFloat, dInteger / dFloat, nError);
+    }
+    //Denormal samples, e.g. from future per-track processing, with and without flush to zero
+    for(int i = 0; i < PERIOD_SIZE * BENCH_KERNEL_TRACKS; ++i)
+        g_pFloatFrames[i] = 1e-39f;
+    double aDenormal[2];
+    for(int nFlush = 0; nFlush < 2; ++nFlush)
+    {
+        SetFlushToZero(nFlush);
+        int64_t nStart = GetMicroseconds();
+        for(int nPeriod = 0; nPeriod < BENCH_KERNEL_PERIODS; ++nPeriod)
+            g_pFloatMixKernel(g_pFloatFrames, PERIOD_SIZE, BENCH_KERNEL_TRACKS, 0, BENCH_KERNEL_TRACKS, pFloatGainA, pFloatGainB, pFloatBus);
+        aDenormal[nFlush] = (GetMicroseconds() - nStart) * 1000.0 / BENCH_KERNEL_PERIODS;
+    }
+    printf("  Denormal input to %s float mix: %.0fns/period, %.0fns/period with flush to zero\n", g_aMixKernels[g_nMixKernel].sName, aDenormal[0], aDenormal[1]);
+    SetFlushToZero(false);
+    delete[] pFrames;
 }
 
-bool Play()
+/** Measure mixdown time with static gains and with gains changing every period, with integer and float mix */
+static void BenchRamp()
 {
-    if(!g_pPcmPlay || (g_fdWave < 0) || ((TC_PLAY != g_nTransport)))
-        return false;
-
-    //Read frame from file
-    //!@todo handle different bits/sample size
-    memset(g_pPlayBuffer, 0, sizeof(g_pPlayBuffer)); //silence output buffer
-    int nRead = read(g_fdWave, g_pReadBuffer, g_nPeriodSize);
-    bool bPlaying = (nRead > 0); //If we fail to read then we should stop
-    if(bPlaying)
+    cout << "Gain ramps, mixdown of " << BENCH_KERNEL_TRACKS << " tracks (" << BENCH_KERNEL_PERIODS << " periods each):" << endl;
+    g_nChannels = BENCH_KERNEL_TRACKS;
+    g_nFrameSize = g_nChannels * SAMPLESIZE;
+    unsigned char* pFrames = new unsigned char[g_nFrameSize * PERIOD_SIZE];
+    for(int i = 0; i < g_nFrameSize * PERIOD_SIZE; ++i)
+        pFrames[i] = rand();
+    g_nMixThreads = 1;
+    StartMixers();
+    SetFlushToZero(true);
+    for(int nFloat = 0; nFloat < 2; ++nFloat)
     {
-        //Mix each frame to output buffer
-        //iterate through input buffer one frame at a time, adding gain-adjusted value to output buffer
-        for(int nPos = 0; nPos < nRead ; nPos += g_nFrameSize)
+        g_bFloat = nFloat;
+        for(int i = 0; i < g_nChannels; ++i)
+            BenchSetGain(i, LevelTable::aLevel[LEVEL_STEPS_6DB]);
+        CompactMixer();
+        int64_t nStart = GetMicroseconds();
+        for(int nPeriod = 0; nPeriod < BENCH_KERNEL_PERIODS; ++nPeriod)
+            Mixdown(pFrames, PERIOD_SIZE);
+        double dStatic = (GetMicroseconds() - nStart) * 1000.0 / BENCH_KERNEL_PERIODS;
+        nStart = GetMicroseconds();
+        for(int nPeriod = 0; nPeriod < BENCH_KERNEL_PERIODS; ++nPeriod)
         {
-            for(int nChan = 0; nChan < g_nChannels; ++nChan)
+            //Level of every track changes by 0.5dB every period
+            for(int i = 0; i < g_nChannels; ++i)
             {
-                int16_t nSample = g_pReadBuffer[nPos + (SAMPLESIZE * nChan)] + (g_pReadBuffer[nPos + (SAMPLESIZE * nChan) + 1] << 8); //get little endian sample into 16-bit word
-                g_pPlayBuffer[nPos / g_nChannels] += g_track[nChan].MixA(nSample);
-                g_pPlayBuffer[nPos / g_nChannels + 1] += g_track[nChan].MixB(nSample);
+                int nLevel = LEVEL_STEPS_6DB + (nPeriod & 1);
+                g_pTargetGainA[i] = g_pTargetGainB[i] = LevelTable::aLevel[nLevel];
+                g_pTargetFloatGainA[i] = g_pTargetFloatGainB[i] = LevelTable::afLevel[nLevel];
             }
+            g_bMixChanged = true;
+            Mixdown(pFrames, PERIOD_SIZE);
         }
-        snd_pcm_sframes_t nBlocks;
-        //Send output buffer to soundcard replay output
-        nBlocks = snd_pcm_writei(g_pPcmPlay, g_pPlayBuffer, PERIOD_SIZE);
-        switch(nBlocks)
-        {
-            case -EBADFD:
-                attron(COLOR_PAIR(WHITE_RED));
-                mvprintw(18, 31, "File descriptor in bad state");
-                attroff(COLOR_PAIR(WHITE_RED));
-                snd_pcm_recover(g_pPcmPlay, nBlocks, 1); //Attempt to recover from error
-                break;
-            case -EPIPE:
-                //Broken Pipe == Underrun
-                attron(COLOR_PAIR(WHITE_RED));
-                mvprintw(18, 0, "Underruns:% 4d", ++g_nUnderruns);
-                attroff(COLOR_PAIR(WHITE_RED));
-                snd_pcm_recover(g_pPcmPlay, nBlocks, 1); //Attempt to recover from error
-                break;
-            case -ESTRPIPE:
-                attron(COLOR_PAIR(WHITE_RED));
-                mvprintw(18, 12, "Streams pipe error");
-                attroff(COLOR_PAIR(WHITE_RED));
-                snd_pcm_recover(g_pPcmPlay, nBlocks, 1); //Attempt to recover from error
-                break;
-        }
-        g_lHeadPos += nBlocks; //!@todo This gives (a couple of ms) too high head position. nRead/g_nFrameSize is correct but extra cpu
+        double dRamp = (GetMicroseconds() - nStart) * 1000.0 / BENCH_KERNEL_PERIODS;
+        printf("  %-7s %8.0fns/period static %8.0fns/period ramping (+%.0f%%)\n", nFloat ? "float" : "integer", dStatic, dRamp, (dRamp / dStatic - 1) * 100);
     }
-    ShowHeadPosition();
-    //Return true if more to play else false if at end of file. Don't fail if we are in record mode
-    return bPlaying;
+    g_bFloat = false;
+    SetFlushToZero(false);
+    StopMixers();
+    g_nMixThreads = 0;
+    delete[] pFrames;
 }
 
-bool Record()
+/** Compare kernels specialised for each width in FRAME_WIDTH with kernels for any quantity of channels */
+static void BenchWidths()
 {
-    if(TC_PLAY != g_nTransport)
-        return false; //Can't record if we are not rolling
-    if(!g_bRecordEnabled)
-        return false; //Don't record if we are not in record mode
-    if(g_fdWave <= 0)
-        return false; //WAVE file not open so nothing to record to
-    if((-1 == g_nRecA) && (-1 == g_nRecB))
-        return false; //No record channels primed
-    if(g_lHeadPos < g_nRecordOffset)
-        return true; //Record head not past start of file
-    if(!g_pPcmRecord && !OpenRecord())
-        return false; //Record device not open and failed to open when we tried - oops!
-    if(g_lHeadPos >= g_nLastFrame)
-    {
-        //extend file if recording
-        ssize_t nWritten = pwrite(g_fdWave, g_pSilence, g_nPeriodSize, g_offEndOfData);
-        if(nWritten > 0)
-        {
-            g_offEndOfData += nWritten;
-            g_nLastFrame += PERIOD_SIZE;;
+    cout << "Kernels specialised by quantity of tracks, " << g_aMixKernels[g_nMixKernel].sName << " (" << BENCH_KERNEL_PERIODS << " periods each):" << endl;
+    cout << "  tracks    mix any  mix fixed          merge any  merge fixed" << endl;
+    unsigned char* pFrames = new unsigned char[MAX_CHANNELS * SAMPLESIZE * PERIOD_SIZE];
+    for(int i = 0; i < MAX_CHANNELS * SAMPLESIZE * PERIOD_SIZE; ++i)
+        pFrames[i] = rand();
+    alignas(16) int16_t pGainA[MAX_CHANNELS];
+    alignas(16) int16_t pGainB[MAX_CHANNELS];
+    for(int i = 0; i < MAX_CHANNELS; ++i)
+    {
+        pGainA[i] = rand() % GAIN_UNITY;
+        pGainB[i] = rand() % GAIN_UNITY;
+    }
+    alignas(64) int32_t pBus[PERIOD_SIZE * 2];
+    unsigned char pRecBuffer[2 * SAMPLESIZE * PERIOD_SIZE];
+    memset(pRecBuffer, 0, sizeof(pRecBuffer));
+    //Merge with replayed frames from history, wrapping part way through period
+    g_nHistoryFrames = PERIOD_SIZE * 3 / 2;
+    g_pHistory = new unsigned char[g_nHistoryFrames * MAX_CHANNELS * SAMPLESIZE];
+    g_lHistoryEnd = PERIOD_SIZE * 2;
+    g_nRecA = 0;
+    g_nRecB = 1;
+    for(int nWidth = 0; nWidth < FRAME_WIDTHS; ++nWidth)
+    {
+        g_nChannels = FRAME_WIDTH[nWidth];
+        g_nFrameSize = g_nChannels * SAMPLESIZE;
+        SelectFrameKernels();
+        MixKernel apMix[2] = {g_aMixKernels[g_nMixKernel].pKernel, GetMixKernel(g_nMixKernel, g_nChannels)};
+        MergeKernel apMerge[2] = {g_aMergeKernels[0], g_pMergeKernel};
+        double aMix[2];
+        double aMerge[2];
+        for(int nFixed = 0; nFixed < 2; ++nFixed)
+        {
+            int64_t nStart = GetMicroseconds();
+            for(int nPeriod = 0; nPeriod < BENCH_KERNEL_PERIODS; ++nPeriod)
+                apMix[nFixed](pFrames, PERIOD_SIZE, g_nFrameSize, 0, g_nChannels, pGainA, pGainB, pBus);
+            aMix[nFixed] = (GetMicroseconds() - nStart) * 1000.0 / BENCH_KERNEL_PERIODS;
+            nStart = GetMicroseconds();
+            for(int nPeriod = 0; nPeriod < BENCH_KERNEL_PERIODS; ++nPeriod)
+                apMerge[nFixed](pFrames, pRecBuffer, PERIOD_SIZE, PERIOD_SIZE);
+            aMerge[nFixed] = (GetMicroseconds() - nStart) * 1000.0 / BENCH_KERNEL_PERIODS;
         }
-        else
-            cerr << "Failed to extend file" << endl;
+        printf("  %6d %8.0fns %8.0fns %5.2fx %8.0fns %8.0fns %5.2fx\n", g_nChannels, aMix[0], aMix[1], aMix[0] / aMix[1], aMerge[0], aMerge[1], aMerge[0] / aMerge[1]);
     }
+    delete[] g_pHistory;
+    g_pHistory = NULL;
+    g_nRecA = -1;
+    g_nRecB = -1;
+    delete[] pFrames;
+}
 
-
-    unsigned char pRecBuffer[2 * SAMPLESIZE * PERIOD_SIZE]; // buffer to hold record frame
-    memset(pRecBuffer, 0, sizeof(pRecBuffer)); //silence record buffer
-    snd_pcm_sframes_t nBlocks = snd_pcm_readi(g_pPcmRecord, pRecBuffer, PERIOD_SIZE);
-    switch(nBlocks)
+/** Measure cost of metering tracks and output alongside each mix kernel and check readings against scalar kernel */
+static void BenchMeter()
+{
+    cout << "Metering every " << METER_DECIMATE << "th frame of every " << METER_INTERVAL << "th period of tracks and output (fastest of " << BENCH_METER_RUNS << " runs of " << BENCH_KERNEL_PERIODS / BENCH_METER_RUNS << " periods):" << endl;
+    unsigned char* pFrames = new unsigned char[MAX_CHANNELS * SAMPLESIZE * PERIOD_SIZE];
+    for(int i = 0; i < MAX_CHANNELS * SAMPLESIZE * PERIOD_SIZE; ++i)
+        pFrames[i] = rand();
+    alignas(16) int16_t pGainA[MAX_CHANNELS];
+    alignas(16) int16_t pGainB[MAX_CHANNELS];
+    for(int i = 0; i < MAX_CHANNELS; ++i)
     {
-        case -EBADFD:
-            attron(COLOR_PAIR(WHITE_RED));
-            mvprintw(19, 31, "File descriptor in bad state");
-            attroff(COLOR_PAIR(WHITE_RED));
-            snd_pcm_recover(g_pPcmRecord, nBlocks, 1); //Attempt to recover from error
-            break;
-        case -EPIPE:
-            //Broken Pipe == Underrun
-            attron(COLOR_PAIR(WHITE_RED));
-            mvprintw(19, 0, "Overruns:% 4d ", ++g_nOverruns);
-            attroff(COLOR_PAIR(WHITE_RED));
-            snd_pcm_recover(g_pPcmRecord, nBlocks, 1); //Attempt to recover from error
-            break;
-        case -ESTRPIPE:
-            attron(COLOR_PAIR(WHITE_RED));
-            mvprintw(19, 12, "Streams pipe error");
-            attroff(COLOR_PAIR(WHITE_RED));
-            snd_pcm_recover(g_pPcmRecord, nBlocks, 1); //Attempt to recover from error
-            break;
+        pGainA[i] = rand() % GAIN_UNITY;
+        pGainB[i] = rand() % GAIN_UNITY;
+    }
+    alignas(64) int32_t pBus[PERIOD_SIZE * 2];
+    const int32_t* ppBuses[1] = {pBus};
+    int16_t pOutput[PERIOD_SIZE * 2];
+    alignas(16) int16_t pPeak[MAX_CHANNELS] = {0};
+    alignas(16) float pSquares[MAX_CHANNELS] = {0};
+    int nMetered = PERIOD_SIZE / METER_DECIMATE;
+    for(unsigned int nTest = 0; nTest < sizeof(BENCH_METER_TRACKS) / sizeof(int); ++nTest)
+    {
+        int nTracks = BENCH_METER_TRACKS[nTest];
+        int nFrameSize = nTracks * SAMPLESIZE;
+        alignas(16) int16_t pReferencePeak[MAX_CHANNELS] = {0};
+        alignas(16) float pReferenceSquares[MAX_CHANNELS] = {0};
+        MeterScalar(pFrames, nMetered, nFrameSize * METER_DECIMATE, 0, nTracks, pReferencePeak, pReferenceSquares);
+        for(int nKernel = 0; nKernel < MIX_KERNELS; ++nKernel)
+        {
+            const MixKernelInfo& kernel = g_aMixKernels[nKernel];
+            if(!kernel.bSupported)
+                continue;
+            MixKernel pMix = GetMixKernel(nKernel, nTracks);
+            g_pMeterKernel = kernel.pMeter;
+            //Overhead is small compared with timing noise so alternate short runs with and without metering and compare the fastest of each
+            double aNanoseconds[2] = {1e9, 1e9};
+            for(int nRun = 0; nRun < 2 * BENCH_METER_RUNS; ++nRun)
+            {
+                bool bMetered = nRun & 1;
+                int64_t nStart = GetMicroseconds();
+                for(int nPeriod = 0; nPeriod < BENCH_KERNEL_PERIODS / BENCH_METER_RUNS; ++nPeriod)
+                {
+                    bool bMeter = bMetered && (0 == nPeriod % METER_INTERVAL);
+                    if(bMeter)
+                        kernel.pMeter(pFrames, nMetered, nFrameSize * METER_DECIMATE, 0, nTracks, pPeak, pSquares);
+                    pMix(pFrames, PERIOD_SIZE, nFrameSize, 0, nTracks, pGainA, pGainB, pBus);
+                    kernel.pPack(ppBuses, 1, PERIOD_SIZE * 2, pOutput);
+                    if(bMeter)
+                        MeterOutput(pOutput, PERIOD_SIZE);
+                }
+                aNanoseconds[bMetered] = min(aNanoseconds[bMetered], (GetMicroseconds() - nStart) * 1000.0 * BENCH_METER_RUNS / BENCH_KERNEL_PERIODS);
+            }
+            double dMix = aNanoseconds[0];
+            double dMetered = aNanoseconds[1];
+            memset(pPeak, 0, sizeof(pPeak));
+            memset(pSquares, 0, sizeof(pSquares));
+            kernel.pMeter(pFrames, nMetered, nFrameSize * METER_DECIMATE, 0, nTracks, pPeak, pSquares);
+            bool bMatch = (0 == memcmp(pPeak, pReferencePeak, nTracks * sizeof(int16_t))) && (0 == memcmp(pSquares, pReferenceSquares, nTracks * sizeof(float)));
+            printf("  %-7s %2d tracks %8.0fns/period mix %8.0fns/period metered (%+.1f%%) %s\n", kernel.sName, nTracks, dMix, dMetered,
+                (dMetered / dMix - 1) * 100, bMatch ? "" : "READINGS DIFFER FROM SCALAR");
+        }
     }
-    //Write samples to file
-    off_t offRewrite = g_offStartOfData + (g_lHeadPos - g_nRecordOffset) * g_nFrameSize;
-    ssize_t nRead = pread(g_fdWave, g_pReadBuffer, g_nPeriodSize, offRewrite);
-    if(nRead != g_nPeriodSize)
-        return false; //Failed to read frame of data
-    for(size_t nSample = 0; nSample < PERIOD_SIZE; ++nSample)
+    g_pMeterKernel = g_aMixKernels[g_nMixKernel].pMeter;
+    ResetMeters();
+    delete[] pFrames;
+}
+
+/** Measure mixdown time with increasing quantity of audible tracks, mixing all channels and gathering audible channels */
+static void BenchCompact()
+{
+    cout << "Mixdown of " << BENCH_COMPACT_TRACKS << " tracks by audible tracks (" << BENCH_KERNEL_PERIODS << " periods each):" << endl;
+    cout << "  audible   all channels   compacted" << endl;
+    g_nChannels = BENCH_COMPACT_TRACKS;
+    g_nFrameSize = g_nChannels * SAMPLESIZE;
+    unsigned char* pFrames = new unsigned char[g_nFrameSize * PERIOD_SIZE];
+    for(int i = 0; i < g_nFrameSize * PERIOD_SIZE; ++i)
+        pFrames[i] = rand();
+    g_nMixThreads = 1;
+    StartMixers();
+    for(int nAudible = 1; nAudible <= g_nChannels; nAudible *= 2)
     {
-        if(-1 != g_nRecA)
+        //Spread audible tracks across file, unmuting them as user would so that gains reach mixer as they do in a project
+        for(int i = 0; i < g_nChannels; ++i)
         {
-            memcpy(g_pReadBuffer + nSample * g_nFrameSize + (g_nRecA * SAMPLESIZE), (pRecBuffer + nSample * 4), SAMPLESIZE);
-//            pwrite(g_fdWave, pRecBuffer + nSample * 4, 2,
-//                g_offStartOfData + (g_lHeadPos + nSample - g_nRecordOffset) * g_nFrameSize  + g_nRecA * SAMPLESIZE);
+            g_track[i].bMute = (0 != i % (g_nChannels / nAudible));
+            g_track[i].nLevel = LEVEL_STEPS_6DB;
         }
-        if(-1 != g_nRecB)
+        PublishMixer();
+        g_mixer.Update();
+        UpdateMixer();
+        RampMixer(); //Ramp to new gains
+        RampMixer(); //Settle at new gains
+        double aNanoseconds[2];
+        for(int nCompact = 0; nCompact < 2; ++nCompact)
         {
-            memcpy(g_pReadBuffer + 2 + nSample * g_nFrameSize + (g_nRecA * SAMPLESIZE), (pRecBuffer + 2 + nSample * 4), SAMPLESIZE);
-//            pwrite(g_fdWave, 2 + pRecBuffer + nSample * 4, 2,
-//                2 + g_offStartOfData + (g_lHeadPos + nSample - g_nRecordOffset) * g_nFrameSize  + g_nRecA * SAMPLESIZE);
+            CompactMixer(nCompact);
+            int64_t nStart = GetMicroseconds();
+            for(int nPeriod = 0; nPeriod < BENCH_KERNEL_PERIODS; ++nPeriod)
+                Mixdown(pFrames, PERIOD_SIZE);
+            aNanoseconds[nCompact] = (GetMicroseconds() - nStart) * 1000.0 / BENCH_KERNEL_PERIODS;
         }
+        printf("  %7d %10.0fns %10.0fns%s\n", nAudible, aNanoseconds[0], aNanoseconds[1], nAudible * g_nCompactRatio <= g_nChannels ? " (used)" : "");
     }
-    pwrite(g_fdWave, g_pReadBuffer, nRead, offRewrite);
-    return true;
+    StopMixers();
+    delete[] pFrames;
+    g_nMixThreads = 0;
+}
+
+void Benchmark()
+{
+    BenchIdle();
+    BenchStart();
+    BenchKernels();
+    BenchFloat();
+    BenchRamp();
+    BenchMeter();
+    BenchWidths();
+    BenchCompact();
+    BenchMix();
 }
 
 bool LoadProject(string sName)
@@ -903,8 +4875,10 @@ bool LoadProject(string sName)
     clrtoeol();
 //    attroff(COLOR_PAIR(WHITE_MAGENTA));
     g_sProject = sName;
-    if(!OpenFile())
+    if(g_bPlanar ? !OpenTracks() : !OpenFile())
         return false;
+    if(g_bMmap)
+        MapFile(); //Replays from read-ahead ring if file cannot be mapped
     attron(COLOR_PAIR(WHITE_MAGENTA));
     mvprintw(0, 45, "Project: %s", sName.c_str());
     attroff(COLOR_PAIR(WHITE_MAGENTA));
@@ -917,20 +4891,35 @@ bool LoadProject(string sName)
     if(pFile)
     {
         char pLine[256];
+        int pLegacyA[MAX_CHANNELS]; //A-leg attenuation (x 6dB, 16 = -Inf) from configuration saved before pan and level were separate
+        int pLegacyB[MAX_CHANNELS]; //B-leg attenuation from old configuration
+        for(int i = 0; i < MAX_CHANNELS; ++i)
+        {
+            pLegacyA[i] = -1;
+            pLegacyB[i] = -1;
+        }
         while(fgets(pLine, sizeof(pLine), pFile))
         {
             if(strnlen(pLine, sizeof(pLine)) < 5)
                 continue;
             int nChannel = (pLine[0] - '0') * 10 + (pLine[1] - '0');
-            if(nChannel >= 0 && nChannel < g_nChannels)
+            if(nChannel >= 0 && nChannel < g_nChannels && nChannel < MAX_CHANNELS)
             {
                 switch(pLine[2])
                 {
+                    case 'V':
+                        //Level
+                        g_track[nChannel].nLevel = max(0, min(LEVEL_STEPS, atoi(pLine + 4)));
+                        break;
+                    case 'P':
+                        //Pan
+                        g_track[nChannel].nPan = max(-PAN_STEPS, min(PAN_STEPS, atoi(pLine + 4)));
+                        break;
                     case 'L':
-                        g_track[nChannel].nMonMixA = atoi(pLine + 4);
+                        pLegacyA[nChannel] = max(0, min(16, atoi(pLine + 4)));
                         break;
                     case 'R':
-                        g_track[nChannel].nMonMixB = atoi(pLine + 4);
+                        pLegacyB[nChannel] = max(0, min(16, atoi(pLine + 4)));
                         break;
                     case 'M':
                         //Mute
@@ -938,23 +4927,72 @@ bool LoadProject(string sName)
                         break;
                 }
             }
+            if('I' == pLine[0] && ('A' == pLine[1] || 'B' == pLine[1]))
+            {
+                //Input monitor
+                Track& monitor = g_aMonitor[pLine[1] - 'A'];
+                switch(pLine[2])
+                {
+                    case 'V':
+                        monitor.nLevel = max(0, min(LEVEL_STEPS, atoi(pLine + 4)));
+                        break;
+                    case 'P':
+                        monitor.nPan = max(-PAN_STEPS, min(PAN_STEPS, atoi(pLine + 4)));
+                        break;
+                    case 'M':
+                        monitor.bMute = (pLine[4] == '1');
+                        break;
+                }
+            }
             if(0 == strncmp(pLine, "Pos=", 4))
-                g_lHeadPos = atoi(pLine + 4); //Set transport position
-            if(0 == strncmp(pLine, "Rof=", 4))
-                g_nRecordOffset = atoi(pLine + 4); //Set record offset
+                g_lHeadPos = atoll(pLine + 4); //Set transport position
         }
         fclose(pFile);
+        for(int i = 0; i < MAX_CHANNELS; ++i)
+        {
+            //Convert old per-leg attenuation to level of louder leg and pan towards it
+            if(pLegacyA[i] < 0 || pLegacyB[i] < 0)
+                continue;
+            int nAttenuation = min(pLegacyA[i], pLegacyB[i]);
+            g_track[i].nLevel = (16 == nAttenuation) ? LEVEL_STEPS : nAttenuation * LEVEL_STEPS_6DB;
+            g_track[i].nPan = (pLegacyA[i] - pLegacyB[i]) * PAN_STEPS / 16;
+        }
     }
-    SetPlayHead(g_lHeadPos);
     g_nPeriodSize = g_nFrameSize * PERIOD_SIZE;
-    g_nRecordOffset = g_nSamplerate * (RECORD_LATENCY + REPLAY_LATENCY) / 1000000;
+    g_nPeriodTime = (int64_t)PERIOD_SIZE * 1000000 / g_nSamplerate;
+    g_nFadeFrames = (int64_t)g_nFadeMs * g_nSamplerate / 1000;
+    g_nMeterPeriods = max(1, (g_nSamplerate * METER_MS / 1000 / PERIOD_SIZE + METER_INTERVAL / 2) / METER_INTERVAL) * METER_INTERVAL; //Same quantity of metered periods in each snapshot
+    ResetMeters();
     //Create new silent period
     delete[] g_pSilence;
     g_pSilence = new char[g_nPeriodSize];
     memset(g_pSilence, 0, g_nPeriodSize);
-    //Create new read buffer
-    delete[] g_pReadBuffer;
-    g_pReadBuffer = new unsigned char[g_nPeriodSize];
+    //Create new record buffers
+    g_nHistoryFrames = RECORD_HISTORY;
+    delete[] g_pHistory;
+    g_pHistory = new unsigned char[g_nHistoryFrames * g_nFrameSize];
+    g_nWriteChunk = (WRITE_CHUNK + g_nPeriodSize - 1) / g_nPeriodSize;
+    int nWriteBlocks = WRITE_SECONDS * g_nSamplerate / PERIOD_SIZE;
+    if(nWriteBlocks < 2 * g_nWriteChunk)
+        nWriteBlocks = 2 * g_nWriteChunk;
+    g_ringWrite.Init(g_nPeriodSize, nWriteBlocks + 1);
+    //Create read-ahead ring of at least two disk reads
+    g_nPrefetchChunk = (PREFETCH_CHUNK + g_nPeriodSize - 1) / g_nPeriodSize;
+    int nPrefetchBlocks = g_fPrefetchSeconds * g_nSamplerate / PERIOD_SIZE;
+    if(nPrefetchBlocks < 2 * g_nPrefetchChunk)
+        nPrefetchBlocks = 2 * g_nPrefetchChunk;
+    g_ringPrefetch.Init(g_nPeriodSize, nPrefetchBlocks + 1);
+    if(g_bPlanar)
+    {
+        //Each track is read and written separately then spread to or gathered from frames
+        delete[] g_pPlanarRead;
+        g_pPlanarRead = new unsigned char[g_nPrefetchChunk * PERIOD_SIZE * SAMPLESIZE];
+        delete[] g_pPlanarWrite;
+        g_pPlanarWrite = new unsigned char[(WRITE_CHUNK / g_nFrameSize + PERIOD_SIZE) * SAMPLESIZE]; //Writes end at first period that reaches WRITE_CHUNK
+    }
+    SelectFrameKernels();
+    CompactMixer();
+    SetPlayHead(g_lHeadPos);
     return true;
 }
 
@@ -976,7 +5014,14 @@ bool SaveProject(string sName)
         sCpCmd.append(g_sPath);
         sCpCmd.append(sName);
         sCpCmd.append(".wav");
-        system(sCpCmd.c_str());
+        if(g_bPlanar)
+        {
+            //Planar project is its track files - interleaved file is only exported on demand
+            for(int nTrack = 0; nTrack < g_nChannels; ++nTrack)
+                system(("cp " + GetTrackFilename(g_sProject, nTrack) + " " + GetTrackFilename(sName, nTrack)).c_str());
+        }
+        else
+            system(sCpCmd.c_str());
         g_sProject = sName;
     }
     sConfig.append(".cfg");
@@ -987,21 +5032,27 @@ bool SaveProject(string sName)
         for(int i = 0; i < g_nChannels; ++i)
         {
             memset(pBuffer, 0, sizeof(pBuffer));
-            sprintf(pBuffer, "%02dL=%d\n", i, g_track[i].nMonMixA);
+            sprintf(pBuffer, "%02dV=%d\n", i, g_track[i].nLevel);
             fputs(pBuffer , pFile);
             memset(pBuffer, 0, sizeof(pBuffer));
-            sprintf(pBuffer, "%02dR=%d\n", i, g_track[i].nMonMixB);
+            sprintf(pBuffer, "%02dP=%d\n", i, g_track[i].nPan);
             fputs(pBuffer , pFile);
             memset(pBuffer, 0, sizeof(pBuffer));
             sprintf(pBuffer, "%02dM=%s",i, g_track[i].bMute?"1\n":"0\n");
             fputs(pBuffer , pFile);
         }
+        for(int nLeg = 0; nLeg < 2; ++nLeg)
+        {
+            sprintf(pBuffer, "I%cV=%d\n", 'A' + nLeg, g_aMonitor[nLeg].nLevel);
+            fputs(pBuffer , pFile);
+            sprintf(pBuffer, "I%cP=%d\n", 'A' + nLeg, g_aMonitor[nLeg].nPan);
+            fputs(pBuffer , pFile);
+            sprintf(pBuffer, "I%cM=%s", 'A' + nLeg, g_aMonitor[nLeg].bMute?"1\n":"0\n");
+            fputs(pBuffer , pFile);
+        }
         memset(pBuffer, 0, sizeof(pBuffer));
-        sprintf(pBuffer, "Pos=%ld\n", g_lHeadPos);
+        sprintf(pBuffer, "Pos=%lld\n", (long long)g_lHeadPos);
         fputs(pBuffer , pFile);
-        memset(pBuffer, 0, sizeof(pBuffer));
-        sprintf(pBuffer, "Rof=%d\n", g_nRecordOffset);
-//        fputs(pBuffer , pFile);
 
         fclose(pFile);
         return true;
@@ -1009,22 +5060,122 @@ bool SaveProject(string sName)
     return false;
 }
 
-int main()
+/** Show command line usage */
+static void Usage(const char* sCommand)
+{
+    cout << "Usage: " << sCommand << " [options]" << endl;
+    cout << "  -p, --prefetch=SECONDS  Duration of audio to read ahead of play head (default " << PREFETCH_SECONDS << ")" << endl;
+    cout << "  -j, --mix-threads=N     Quantity of threads mixing each period (default one per CPU core, max " << MAX_MIX_THREADS << ")" << endl;
+    cout << "  -F, --fade=MS           Duration of monitor fade in / out when transport starts / stops (default " << FADE_MS << ", 0 for none)" << endl;
+    cout << "  -f, --float             Mix with 32-bit float rather than 16-bit integer" << endl;
+    cout << "  -m, --monitor           Monitor input: mix captured input to output, heard " << MONITOR_PERIODS << " periods after capture" << endl;
+    cout << "  -M, --mmap              Replay directly from memory-mapped WAVE file rather than copying it to read-ahead buffer" << endl;
+    cout << "  -P, --planar            Store each track in its own mono WAVE file, reading only audible and armed tracks" << endl;
+    cout << "  -r, --rt[=PRIORITY]     Real-time mode: SCHED_FIFO audio thread (default priority " << RT_PRIORITY << "), locked and prefaulted memory" << endl;
+    cout << "  -b, --bench             Run performance benchmarks then exit" << endl;
+    cout << "  -h, --help              Show this help" << endl;
+}
+
+int main(int argc, char** argv)
 {
+    static const option aOptions[] =
+    {
+        {"prefetch", required_argument, NULL, 'p'},
+        {"mix-threads", required_argument, NULL, 'j'},
+        {"fade", required_argument, NULL, 'F'},
+        {"float", no_argument, NULL, 'f'},
+        {"monitor", no_argument, NULL, 'm'},
+        {"mmap", no_argument, NULL, 'M'},
+        {"planar", no_argument, NULL, 'P'},
+        {"rt", optional_argument, NULL, 'r'},
+        {"bench", no_argument, NULL, 'b'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    int nOption;
+    bool bBenchmark = false;
+    while((nOption = getopt_long(argc, argv, "p:j:F:fmMPr::bh", aOptions, NULL)) != -1)
+    {
+        switch(nOption)
+        {
+            case 'p':
+                g_fPrefetchSeconds = atof(optarg);
+                break;
+            case 'j':
+                g_nMixThreads = atoi(optarg);
+                break;
+            case 'F':
+                g_nFadeMs = max(0, atoi(optarg));
+                break;
+            case 'f':
+                g_bFloat = true;
+                break;
+            case 'm':
+                g_bMonitor = true;
+                break;
+            case 'M':
+                g_bMmap = true;
+                break;
+            case 'P':
+                g_bPlanar = true;
+                break;
+            case 'r':
+                g_bRealtime = true;
+                if(optarg)
+                    g_nRtPriority = atoi(optarg);
+                break;
+            case 'b':
+                bBenchmark = true;
+                break;
+            default:
+                Usage(argv[0]);
+                return 'h' == nOption ? 0 : 1;
+        }
+    }
+
     g_nDebug = 0;
     g_nTransport = TC_STOP;
     g_bRecordEnabled = false;
     g_nSelectedTrack = 0;
     g_nRecA = -1; //Deselect A-channel recording
     g_nRecB = -1; //Deselect B-channel recording
+    g_aMonitor[0].nPan = -PAN_STEPS; //Monitor A-leg input on left and B-leg on right
+    g_aMonitor[1].nPan = PAN_STEPS;
     g_fdWave = -1;
+    for(int nTrack = 0; nTrack < MAX_CHANNELS; ++nTrack)
+        g_afdTrack[nTrack] = -1;
     g_pPcmPlay = NULL;
     g_pPcmRecord = NULL;
     g_pSilence = NULL;
-    g_pReadBuffer = NULL;
+    g_pHistory = NULL;
     g_nChannels = MAX_TRACKS;
-    g_nRecordOffset = SAMPLERATE * (RECORD_LATENCY + REPLAY_LATENCY) / 1000000;
     g_sPath = "/media/multitrack/"; //!@todo replace this absolute path
+    g_fdEngineWake = eventfd(0, EFD_NONBLOCK);
+    g_fdUiWake = eventfd(0, EFD_NONBLOCK);
+    g_fdPrefetchWake = eventfd(0, EFD_NONBLOCK);
+    g_fdWriteWake = eventfd(0, EFD_NONBLOCK);
+    SelectMixKernel();
+    if(bBenchmark)
+    {
+        Benchmark();
+        return 0;
+    }
+    if(g_bRealtime)
+    {
+        //Lock current and future memory so that audio thread never waits for paging
+        if(g_nRtPriority < sched_get_priority_min(SCHED_FIFO) || g_nRtPriority > sched_get_priority_max(SCHED_FIFO))
+        {
+            cerr << "Real-time priority must be between " << sched_get_priority_min(SCHED_FIFO) << " and " << sched_get_priority_max(SCHED_FIFO) << endl;
+            return 1;
+        }
+        int nLock = MCL_CURRENT | MCL_FUTURE;
+#ifdef MCL_ONFAULT
+        if(g_bMmap)
+            nLock |= MCL_ONFAULT; //Lock mapped WAVE file only as disk thread reads it rather than all of it when it is mapped
+#endif
+        if(mlockall(nLock))
+            g_nLockError = errno;
+    }
     initscr();
     noecho();
     curs_set(0);
@@ -1039,45 +5190,93 @@ int main()
     mvprintw(0, 0, "                                             ");
     attroff(COLOR_PAIR(WHITE_MAGENTA));
     LoadProject("default");
+    PublishMixer();
 
-    g_pWindowRouting = newwin(MAX_TRACKS, 40, 1, 0);
+    g_pWindowRouting = newwin(MAX_TRACKS, 52, 1, 0);
     refresh();
     ShowMenu();
-
-    //Set stdin to non-blocking
-    termios flags;
-    if(tcgetattr(fileno(stdin), &flags) < 0)
-    {
-        /* handle error */
-        cerr << "Failed to get terminal attributes" << endl;
-    }
-    flags.c_lflag &= ~ICANON; // set raw (unset canonical modes)
-    flags.c_cc[VMIN] = 0; // i.e. min 1 char for blocking, 0 chars for non-blocking
-    flags.c_cc[VTIME] = 0; // block if waiting for char
-    if(tcsetattr(fileno(stdin), TCSANOW, &flags) < 0)
+    if(g_bRealtime)
     {
-        /* handle error */
-        cerr << "Failed to set terminal attributes" << endl;
+        //Fault in all engine buffers before audio starts
+        Prefault(g_pSilence, g_nPeriodSize);
+        Prefault(g_pHistory, g_nHistoryFrames * g_nFrameSize);
+        Prefault(g_pPlayBuffer, sizeof(g_pPlayBuffer));
+        Prefault(&g_queueCommands, sizeof(g_queueCommands));
+        g_ringPrefetch.Prefault();
+        g_ringWrite.Prefault();
     }
 
+    StartEngine();
+
+    //User interface sleeps until keypress, audio thread state change or refresh timer (only whilst rolling)
+    nodelay(stdscr, TRUE);
+    int fdTimer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    bool bTimer = false;
     g_bLoop = true;
 
     while(g_bLoop)
     {
-        HandleControl();
-        if(!Record())
-            CloseRecord();
-        if(!Play() && TC_PLAY == g_nTransport)
-            CloseReplay();
-        if(TC_STOP == g_nTransport)
-            usleep(1000);
+        bool bRolling = (TC_STOP != g_nTransport);
+        if(bRolling != bTimer)
+        {
+            itimerspec tsRefresh;
+            memset(&tsRefresh, 0, sizeof(tsRefresh));
+            if(bRolling)
+            {
+                tsRefresh.it_value.tv_nsec = UI_REFRESH * 1000000;
+                tsRefresh.it_interval.tv_nsec = UI_REFRESH * 1000000;
+            }
+            timerfd_settime(fdTimer, 0, &tsRefresh, NULL);
+            bTimer = bRolling;
+        }
+        pollfd aFds[3] = {{fileno(stdin), POLLIN, 0}, {fdTimer, POLLIN, 0}, {g_fdUiWake, POLLIN, 0}};
+        if(poll(aFds, 3, -1) < 0)
+            continue;
+        uint64_t nValue;
+        if(aFds[1].revents)
+            read(fdTimer, &nValue, sizeof(nValue));
+        if(aFds[2].revents)
+            read(g_fdUiWake, &nValue, sizeof(nValue));
+        bool bInput = false;
+        while(HandleControl())
+            bInput = true; //Handle all queued keypresses
+        if(bInput)
+            PublishMixer();
+        if(g_nStorageTask)
+            RunStorageTask();
+        ShowHeadPosition();
+        ShowStatus();
+        ShowTiming();
+        ShowMenu();
     }
-    CloseReplay();
-    CloseRecord();
+    close(fdTimer);
+    StopEngine();
+    close(g_fdPrefetchWake);
+    close(g_fdWriteWake);
+    close(g_fdEngineWake);
+    close(g_fdUiWake);
     SaveProject();
     CloseFile();
     delete[] g_pSilence;
-    delete[] g_pReadBuffer;
+    delete[] g_pHistory;
+    delete[] g_pPlanarRead;
+    delete[] g_pPlanarWrite;
     endwin();
+    if(g_aTiming[PHASE_CYCLE].GetCount())
+    {
+        //Show where time went so that a session's near misses are not lost with the display
+        char pBuffer[64];
+        cout << "Period timing (us, period " << g_nPeriodTime << "us):" << endl;
+        cout << TIMING_HEADER << endl;
+        for(int nPhase = 0; nPhase < PHASES; ++nPhase)
+        {
+            FormatTiming(nPhase, pBuffer, sizeof(pBuffer));
+            cout << pBuffer << endl;
+        }
+    }
+    if(g_bRealtime && g_nRtError)
+        cerr << "Real-time priority " << g_nRtPriority << " refused: " << strerror(g_nRtError) << " - check rtprio in /etc/security/limits.conf or run as root" << endl;
+    if(g_bRealtime && g_nLockError)
+        cerr << "Memory lock failed: " << strerror(g_nLockError) << " - check memlock in /etc/security/limits.conf" << endl;
     return 0;
 }